@@ -1,65 +1,147 @@
 #include <iostream>
 #include <string>
-#include <set>
+#include <cstring>
+#include <stdexcept>
 #include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "client.hpp"
 #include "geometry.hpp"
+#include "trace.hpp"
 
 using namespace Protocol;
 using namespace Geometry;
 
-LaserTagClient::LaserTagClient(boost::asio::io_service &io_service, std::string hostname, std::string service_id) 
-    : socket_(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0)),
+namespace {
+
+// Players the server has not sent for this many packets are dropped from the world, in case a leave went missing
+const unsigned int kStaleGenerations = 600;
+
+}
+
+LaserTagClient::LaserTagClient(boost::asio::io_service &io_service, std::string hostname, std::string service_id, const Arena &arena, bool spectate, bool frontdoor) 
+    : arena_(arena),
+      arena_hash_(arena.Hash()),
+      socket_(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0)),
       timeout_timer_(io_service),
       send_timer_(io_service),
-      laser_timer_(io_service),
-      laser_available_timer_(io_service),
-      players_(std::map<int, Player>()),
-      seq_num_(0),
-      laser_available_(true) {
+      spectate_(spectate),
+      receiving_(false),
+      have_cookie_(false),
+      players_(kStaleGenerations),
+      red_score_(0),
+      blue_score_(0),
+      last_server_seq_num_(0),
+      seq_num_(1),
+      have_local_data_(false),
+      send_scheduler_(10, 30, 16000),
+      my_spawn_count_(0) {
     // Resolve server endpoint
     boost::asio::ip::udp::resolver resolver(io_service);
     boost::asio::ip::udp::resolver::query query(boost::asio::ip::udp::v4(), hostname, service_id);
     endpoint_ = *resolver.resolve(query);
 
-    // Request to enter game at server
-    RequestEnterGame();
+    // Ask the front door where to play, or request to enter game at server right away
+    if (frontdoor) {
+        Locate();
+    } else {
+        RequestEnterGame();
+    }
 }
 
-std::map<int, Player> &LaserTagClient::Players() {
-    return players_;
+bool LaserTagClient::PollWorld() {
+    // Pick up the latest snapshot from the network thread, if any
+    Trace::Span span("PollWorld");
+    if (!world_.Update()) {
+        return false;
+    }
+    span.SetArg("seq", world_.Front().server_seq_num);
+
+    // Find the server's view of our player
+    const WorldSnapshot &world = world_.Front();
+    for (const Player &player : world.players) {
+        if (player.PlayerNum() != world.my_player_num) {
+            continue;
+        }
+
+        if (!local_player_) {
+            // First time we see ourselves, the server state already includes any spawn so far
+            local_player_.reset(new Player(player));
+            applied_spawn_count_ = world.my_spawn_count;
+            PublishLocalPlayer();
+        }
+        break;
+    }
+
+    // Only change to server coordinates when the server spawned us
+    if (local_player_ && applied_spawn_count_ != world.my_spawn_count) {
+        local_player_->Update(world.my_spawn);
+        applied_spawn_count_ = world.my_spawn_count;
+        PublishLocalPlayer();
+    }
+
+    return true;
+}
+
+const WorldSnapshot &LaserTagClient::World() {
+    return world_.Front();
+}
+
+const Player *LaserTagClient::LocalPlayer() {
+    return local_player_.get();
+}
+
+const Arena &LaserTagClient::GetArena() {
+    return arena_;
 }
 
 std::pair<int, int> LaserTagClient::GetScore() {
-    return std::pair<int, int>(red_score_, blue_score_);
+    return std::pair<int, int>(World().red_score, World().blue_score);
 }
 
 int LaserTagClient::GetPlayerNum() {
-    return my_player_num_;
+    return World().my_player_num;
+}
+
+float LaserTagClient::Rtt() {
+    return World().rtt;
+}
+
+float LaserTagClient::Jitter() {
+    return World().jitter;
+}
+
+double LaserTagClient::ServerTick() {
+    // The snapshot carries the clock estimate, so the tick can be read for any moment on the UI thread
+    const ClockSync::ServerClock &clock = World().server_clock;
+    return clock.Synchronized() ? clock.ServerTick(ClockSync::Clock::now()) : -1;
 }
 
 void LaserTagClient::UpdateState(Input input) {
-    // Lock data
-    mutex_.lock();
+    TRACE_SCOPE("UpdateState");
+
+    // Nothing to control until we are in the game
+    if (!local_player_) {
+        return;
+    }
 
-    // Handle input
+    // Handle input, movement into obstacles is undone below
+    Vector2D position = local_player_->Position();
     switch (input) {
         case (Up) : {
-            MyPlayer().MoveForward();
+            local_player_->MoveForward();
             break;
         }
         case (Down) : {
-            MyPlayer().MoveBackward();
+            local_player_->MoveBackward();
             break;    
         }
         case (Left) : {
-            MyPlayer().RotateLeft();
+            local_player_->RotateLeft();
             break;
         }
         case (Right) : {
-            MyPlayer().RotateRight();
+            local_player_->RotateRight();
             break;
         }
         case (Space) : {
@@ -69,21 +151,95 @@ void LaserTagClient::UpdateState(Input input) {
             break;
     }
 
-    // Unlock
-    mutex_.unlock();
+    if (arena_.Collides(local_player_->Position(), Player::kRadius)) {
+        local_player_->SetPosition(position);
+    }
+
+    // Hand our new state to the network thread
+    PublishLocalPlayer();
 }
 
-void LaserTagClient::RequestEnterGame() {
-    // Create and send request packet to server
+bool LaserTagClient::UpdateLaser() {
+    // Turn the laser off once it has fired for long enough
+    if (!local_player_ || !local_player_->Laser() || std::chrono::steady_clock::now() < laser_off_time_) {
+        return false;
+    }
+
+    local_player_->SetLaser(false);
+    PublishLocalPlayer();
+    return true;
+}
+
+void LaserTagClient::Locate() {
+    // Ask the front door for a server
     std::shared_ptr<ClientDataHeader> request(new ClientDataHeader());
-    request->request = true;
+    request->version = kVersion;
+    request->request = locate_request;
     socket_.async_send_to(boost::asio::buffer(request.get(), sizeof(ClientDataHeader)), endpoint_, 
-            boost::bind(&LaserTagClient::OnRequestEnterGame, this, _1, _2, request));
+            boost::bind(&LaserTagClient::OnLocate, this, _1, _2, request));
 }
 
-void LaserTagClient::OnRequestEnterGame(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<ClientDataHeader> request) {
-    // Begin receiving game data with initial flag set
-    ReceiveGameData(true);
+void LaserTagClient::OnLocate(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<ClientDataHeader> request) {
+    // Wait for the redirect, keeping a single receive outstanding across retries
+    if (!receiving_) {
+        receiving_ = true;
+        ReceiveRedirect();
+    }
+
+    // Ask again if the front door does not answer, it may have no servers yet
+    timeout_timer_.expires_from_now(boost::posix_time::seconds(1));
+    timeout_timer_.async_wait(boost::bind(&LaserTagClient::OnLocateTimeout, this, _1));
+}
+
+void LaserTagClient::OnLocateTimeout(const boost::system::error_code &error) {
+    if (error) {
+        // Timer was cancelled i.e. the redirect was received
+        return;
+    }
+
+    Locate();
+}
+
+void LaserTagClient::ReceiveRedirect() {
+    socket_.async_receive_from(boost::asio::buffer(receive_buffer_), receive_endpoint_, MakeCustomAllocHandler(receive_handler_memory_, 
+            [this](const boost::system::error_code &error, size_t bytes_transmitted) { OnReceiveRedirect(error, bytes_transmitted); }));
+}
+
+void LaserTagClient::OnReceiveRedirect(const boost::system::error_code &error, size_t bytes_transmitted) {
+    const Redirect *redirect = reinterpret_cast<const Redirect *>(receive_buffer_);
+    if (error || receive_endpoint_ != endpoint_ || bytes_transmitted < sizeof(Redirect) || redirect->version != kVersion) {
+        // Keep waiting for a proper reply
+        ReceiveRedirect();
+        return;
+    }
+    receiving_ = false;
+    timeout_timer_.cancel();
+
+    // Play on the server we were sent to
+    endpoint_ = boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4(redirect->address), redirect->port);
+    std::cout << "Joining " << endpoint_.address() << ":" << endpoint_.port() << std::endl;
+    RequestEnterGame();
+}
+
+void LaserTagClient::RequestEnterGame() {
+    // Create and send request packet to server, echoing the server's cookie once we have one, and for joins our arena
+    std::shared_ptr<ClientDataHeader> request(new ClientDataHeader());
+    request->version = kVersion;
+    request->request = spectate_ ? spectate_request : join_request;
+    std::shared_ptr<JoinCookie> cookie(new JoinCookie(cookie_));
+    boost::array<boost::asio::const_buffer, 3> buffer = {boost::asio::buffer(request.get(), sizeof(ClientDataHeader)), 
+        boost::asio::buffer(cookie.get(), have_cookie_ ? sizeof(JoinCookie) : 0), 
+        boost::asio::buffer(&arena_hash_, have_cookie_ && !spectate_ ? sizeof(arena_hash_) : 0)};
+    socket_.async_send_to(buffer, endpoint_, boost::bind(&LaserTagClient::OnRequestEnterGame, this, _1, _2, request, cookie));
+}
+
+void LaserTagClient::OnRequestEnterGame(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<ClientDataHeader> request, 
+        std::shared_ptr<JoinCookie> cookie) {
+    // Begin receiving game data with initial flag set, retries reuse the receive that is already outstanding
+    if (!receiving_) {
+        receiving_ = true;
+        ReceiveGameData(true);
+    }
 
     // Set a timer to re-request entry to the game if we time out
     timeout_timer_.expires_from_now(boost::posix_time::seconds(1));
@@ -101,128 +257,212 @@ void LaserTagClient::OnEnterGameTimeout(const boost::system::error_code &error)
 }
 
 void LaserTagClient::ReceiveGameData(bool initial) {
-    // Receive game data in form of header data and vector of player states
-    std::shared_ptr<ServerDataHeader> header(new ServerDataHeader());
-    std::shared_ptr<std::vector<TransmittedData>> data(new std::vector<TransmittedData>(32));
-    boost::array<boost::asio::mutable_buffer, 2> buffer = {boost::asio::buffer(header.get(), sizeof(ServerDataHeader)), boost::asio::buffer(*data)};
-    
-    // Special work to do if this is the initial receiving of data
+    // Receive a whole datagram of header, events and player states into the same buffer every time,
+    // only one receive is ever outstanding so its handler reuses the same memory too
     if (initial) {
-        socket_.async_receive_from(buffer, endpoint_, boost::bind(&LaserTagClient::OnReceiveInitialGameData, this, _1, _2, header, data));
+        socket_.async_receive_from(boost::asio::buffer(receive_buffer_), receive_endpoint_, MakeCustomAllocHandler(receive_handler_memory_, 
+                [this](const boost::system::error_code &error, size_t bytes_transmitted) { OnReceiveInitialGameData(error, bytes_transmitted); }));
     } else {
-        socket_.async_receive_from(buffer, endpoint_, boost::bind(&LaserTagClient::OnReceiveGameData, this, _1, _2, header, data));
+        socket_.async_receive_from(boost::asio::buffer(receive_buffer_), receive_endpoint_, MakeCustomAllocHandler(receive_handler_memory_, 
+                [this](const boost::system::error_code &error, size_t bytes_transmitted) { OnReceiveGameData(error, bytes_transmitted); }));
     }
 }
 
-void LaserTagClient::OnReceiveInitialGameData(const boost::system::error_code &error, size_t bytes_transmitted,
-        std::shared_ptr<ServerDataHeader> transmitted_data_header, std::shared_ptr<std::vector<TransmittedData>> transmitted_data) {
+void LaserTagClient::OnReceiveInitialGameData(const boost::system::error_code &error, size_t bytes_transmitted) {
+    // The server answers a join without a valid cookie with a challenge, echo its cookie straight back
+    const JoinChallenge *challenge = reinterpret_cast<const JoinChallenge *>(receive_buffer_);
+    if (!error && bytes_transmitted >= sizeof(JoinChallenge) && challenge->version == kVersion && challenge->client_player_num == kChallengePlayerNum) {
+        // Collisions and lasers are checked against the server's map, playing or watching on another makes no sense
+        if (challenge->arena_hash != arena_hash_) {
+            throw std::runtime_error("Server plays a different map, start the client with the server's --map");
+        }
+        cookie_ = challenge->cookie;
+        have_cookie_ = true;
+        RequestEnterGame();
+        ReceiveGameData(true);
+        return;
+    }
+
+    ServerPacketView packet;
+    if (error || !packet.Parse(receive_buffer_, bytes_transmitted)) {
+        // Keep waiting for a proper reply
+        ReceiveGameData(true);
+        return;
+    }
+
     // Cancel timer after we receive game data
     timeout_timer_.cancel();
 
-    // Get the sequence number of server
-    last_server_seq_num_ = transmitted_data_header->server_seq_num;
-
     // Get our data
-    my_player_num_ = transmitted_data_header->client_player_num;
+    my_player_num_ = packet.Header().client_player_num;
     
     // Receive data as usual
-    OnReceiveGameData(error, bytes_transmitted, transmitted_data_header, transmitted_data);
+    OnReceiveGameData(error, bytes_transmitted);
     
     // Begin sending current data
-    send_timer_.expires_from_now(boost::posix_time::milliseconds(50));
+    send_timer_.expires_from_now(boost::posix_time::microseconds(send_scheduler_.Interval().count()));
     send_timer_.async_wait(boost::bind(&LaserTagClient::SendPlayerData, this, _1));
 }
 
-void LaserTagClient::OnReceiveGameData(const boost::system::error_code &error, size_t bytes_transmitted, 
-        std::shared_ptr<ServerDataHeader> transmitted_data_header, std::shared_ptr<std::vector<TransmittedData>> transmitted_data) {
-    // Check sequence number of header is in the correct order
-    if (transmitted_data_header->server_seq_num > last_server_seq_num_) {
-    
-        // Update header variables
-        last_server_seq_num_ = transmitted_data_header->server_seq_num;
-        red_score_ = transmitted_data_header->red_score;
-        blue_score_ = transmitted_data_header->blue_score;
-
-        // Fetch data from buffer into our map
-        transmitted_data->resize(transmitted_data_header->num_players);
-        std::set<int> active_players;
-        for (TransmittedData player_data : *transmitted_data) {
-            InsertOrUpdatePlayer(player_data.player_num, player_data);
-            active_players.insert(player_data.player_num);
-        }
+void LaserTagClient::OnReceiveGameData(const boost::system::error_code &error, size_t bytes_transmitted) {
+    // Drop anything too short to hold what the header says it holds
+    Trace::Span span("OnReceiveGameData");
+    ServerPacketView packet;
+    if (error || !packet.Parse(receive_buffer_, bytes_transmitted)) {
+        ReceiveGameData(false);
+        return;
+    }
+    const ServerDataHeader &header = packet.Header();
+    span.SetArg("seq", header.server_seq_num);
+
+    // Acknowledge every packet and feed the link quality estimates of the send scheduler
+    SendScheduler::Clock::time_point now = SendScheduler::Clock::now();
+    acks_.OnReceived(header.server_seq_num);
+    send_scheduler_.OnReceived(header.server_seq_num);
+    send_scheduler_.OnAck(header.ack);
+
+    // Measure the round trip from our echoed times and follow the server's clock
+    if (timing_.OnReceived(header.send_time, header.echo_time, header.echo_delay, now)) {
+        send_scheduler_.OnRttSample(timing_.LastSample(), timing_.Rtt(), now);
+        server_clock_.OnRttSample(header.send_time, timing_.LastSample(), now);
+    }
+    server_clock_.OnTick(header.server_tick, header.send_time);
 
-        // Remove inactive players
-        for (auto iter = players_.begin(); iter != players_.end(); /* */) {
-            if (active_players.find(iter->first) == active_players.end()) {
-                players_.erase(iter++);
-            } else {
-                iter++;
+    // Events are reliable, so take them from late packets too and apply them in order
+    bool changed = false;
+    for (const GameEvent *event = packet.EventsBegin(); event != packet.EventsEnd(); event++) {
+        events_.OnReceived(*event);
+    }
+    GameEvent event;
+    while (events_.Next(event)) {
+        HandleEvent(event);
+        changed = true;
+    }
+
+    // Player state is latest wins, check sequence number of header is in the correct order
+    if (header.server_seq_num > last_server_seq_num_) {
+        last_server_seq_num_ = header.server_seq_num;
+
+        // Copy states straight out of the datagram, snapshots only carry the players that matter most to us. Our own
+        // state is always there, and is where we spawned when the server counts a new spawn. That goes to the UI
+        // thread, which owns our player.
+        for (const TransmittedData *data = packet.PlayersBegin(); data != packet.PlayersEnd(); data++) {
+            InsertOrUpdatePlayer(*data);
+            if (data->player_num == static_cast<unsigned int>(my_player_num_) && header.spawn_count != my_spawn_count_) {
+                my_spawn_ = *data;
+                my_spawn_count_ = header.spawn_count;
             }
         }
+        changed = true;
+    }
+
+    // Hand the new state to the UI thread
+    if (changed) {
+        PublishWorld();
     }
 
     // Receive next
     ReceiveGameData(false);
 }
 
-void LaserTagClient::InsertOrUpdatePlayer(int player_num, TransmittedData &data) {
-    auto iter = players_.find(player_num);
-    if (iter == players_.end()) {
-        players_.insert(std::make_pair(player_num, Player(data)));
-    } else {
-        if (player_num == my_player_num_) {
-            // If we are updating ourselves, only change to server coordinates if we moved a long distance (i.e. respawned)
-            Vector2D new_pos(data.x_pos, data.y_pos);
-            Vector2D cur_pos = iter->second.Position();
-            if (Norm(new_pos - cur_pos) > 25) {
-                iter->second.Update(data);
-            }
-        } else {
-            iter->second.Update(data);
+void LaserTagClient::HandleEvent(const GameEvent &event) {
+    switch (event.type) {
+        case (score_changed) : {
+            red_score_ = event.red_score;
+            blue_score_ = event.blue_score;
+            break;
         }
+        case (player_left) : {
+            players_.Remove(event.player_num);
+            break;
+        }
+        default:
+            // Joins and hits need no bookkeeping, the players' states and spawns follow in snapshots
+            break;
     }
 }
 
+void LaserTagClient::InsertOrUpdatePlayer(const TransmittedData &data) {
+    players_.Update(data, last_server_seq_num_);
+}
+
+void LaserTagClient::PublishWorld() {
+    // Fill the back buffer, reusing its storage from earlier snapshots
+    WorldSnapshot &world = world_.Back();
+    world.my_player_num = my_player_num_;
+    world.server_seq_num = last_server_seq_num_;
+    world.red_score = red_score_;
+    world.blue_score = blue_score_;
+    world.my_spawn = my_spawn_;
+    world.my_spawn_count = my_spawn_count_;
+    world.rtt = timing_.Rtt();
+    world.jitter = timing_.Jitter();
+    world.server_clock = server_clock_;
+    world.players.clear();
+
+    // Single pass over the table, dropping players whose state stopped arriving
+    players_.ForEachActive(last_server_seq_num_, [&world](const TransmittedData &data) {
+        world.players.push_back(Player(data));
+    });
+
+    world_.Publish();
+}
+
 void LaserTagClient::SendPlayerData(const boost::system::error_code &error) {
-    // Create packet
-    std::shared_ptr<ClientDataHeader> header(new ClientDataHeader());
-    header->request = false;
-    header->seq_num = seq_num_++;
-    std::shared_ptr<TransmittedData> data(new TransmittedData(MyPlayer().Data()));
-    boost::array<boost::asio::const_buffer, 2> buffer = {boost::asio::buffer(header.get(), sizeof(ClientDataHeader)), boost::asio::buffer(data.get(), sizeof(TransmittedData))};
+    Trace::Span span("SendPlayerData");
+
+    // Pick up our latest state from the UI thread
+    if (local_data_.Update()) {
+        have_local_data_ = true;
+    }
 
-    // Send asynchronously
-    socket_.async_send_to(buffer, endpoint_, boost::bind(&LaserTagClient::OnSendPlayerData, this, _1, _2, header,data));
+    // Only send when the scheduler says we are due and within budget, spectators only send acks
+    size_t packet_bytes = sizeof(ClientDataHeader) + (spectate_ ? 0 : sizeof(TransmittedData));
+    SendScheduler::Clock::time_point now = SendScheduler::Clock::now();
+    if ((spectate_ || have_local_data_) && send_scheduler_.ShouldSend(now, packet_bytes)) {
+        // Create packet
+        std::shared_ptr<ClientDataHeader> header(new ClientDataHeader());
+        header->version = kVersion;
+        header->request = spectate_ ? spectator_ack : no_request;
+        header->seq_num = seq_num_++;
+        span.SetArg("seq", header->seq_num);
+        header->ack = acks_.Ack();
+        header->ack_bits = acks_.AckBits();
+        timing_.Stamp(now, header->send_time, header->echo_time, header->echo_delay);
+        send_scheduler_.OnSent(header->seq_num, now, packet_bytes);
+        std::shared_ptr<TransmittedData> data(new TransmittedData(local_data_.Front()));
+        boost::array<boost::asio::const_buffer, 2> buffer = {boost::asio::buffer(header.get(), sizeof(ClientDataHeader)), 
+            boost::asio::buffer(data.get(), packet_bytes - sizeof(ClientDataHeader))};
+
+        // Send asynchronously
+        socket_.async_send_to(buffer, endpoint_, boost::bind(&LaserTagClient::OnSendPlayerData, this, _1, _2, header,data));
+    } else {
+        // Nothing to send now, try again next interval
+        OnSendPlayerData(error, 0, std::shared_ptr<ClientDataHeader>(), std::shared_ptr<TransmittedData>());
+    }
 }
 
 void LaserTagClient::OnSendPlayerData(const boost::system::error_code &error, size_t bytes_transmitted, std::shared_ptr<ClientDataHeader> header, std::shared_ptr<TransmittedData> data) {
-    // Timer for the next send
-    send_timer_.expires_from_now(boost::posix_time::milliseconds(50));
+    // Timer for the next send at the scheduler's current rate
+    send_timer_.expires_from_now(boost::posix_time::microseconds(send_scheduler_.Interval().count()));
     send_timer_.async_wait(boost::bind(&LaserTagClient::SendPlayerData, this, _1));
 }
 
 void LaserTagClient::Laser() {
     // Only fire laser if available (prevent spamming)
-    if (laser_available_ == false) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now < laser_available_time_) {
         return;
     }
 
-    MyPlayer().SetLaser(true);
-    laser_available_ = false;
+    local_player_->SetLaser(true);
     
-    // Laser fires for a quarter second
-    laser_timer_.expires_from_now(boost::posix_time::milliseconds(250));
-    laser_timer_.async_wait([this](const boost::system::error_code &error) {
-        this->MyPlayer().SetLaser(false);
-    });
-
-    // Laser is ready to fire again in 1 seconds
-    laser_available_timer_.expires_from_now(boost::posix_time::seconds(1));
-    laser_available_timer_.async_wait([this](const boost::system::error_code &error) {
-        this->laser_available_ = true;
-    });
+    // Laser fires for a quarter second and is ready to fire again in 1 second
+    laser_off_time_ = now + std::chrono::milliseconds(250);
+    laser_available_time_ = now + std::chrono::seconds(1);
 }
 
-Player &LaserTagClient::MyPlayer() {
-    return players_.find(my_player_num_)->second;
+void LaserTagClient::PublishLocalPlayer() {
+    local_data_.Back() = local_player_->Data();
+    local_data_.Publish();
 }
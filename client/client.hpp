@@ -2,11 +2,20 @@
 #define CLIENT_H
 
 #include <vector>
-#include <mutex>
+#include <memory>
+#include <chrono>
 #include <boost/asio.hpp>
 
 #include "player.hpp"
 #include "protocol.hpp"
+#include "triple_buffer.hpp"
+#include "send_scheduler.hpp"
+#include "reliability.hpp"
+#include "arena.hpp"
+#include "packet_view.hpp"
+#include "handler_allocator.hpp"
+#include "player_table.hpp"
+#include "clock_sync.hpp"
 
 typedef enum {
     Up = 101,
@@ -16,46 +25,111 @@ typedef enum {
     Space = 32
 } Input;
 
+// Immutable view of the game published by the network thread for the UI thread
+struct WorldSnapshot {
+    int my_player_num = -1;
+    unsigned int server_seq_num = 0;  // Latest server packet reflected in the snapshot
+    int red_score = 0;
+    int blue_score = 0;
+    unsigned int my_spawn_count = 0;
+    Protocol::TransmittedData my_spawn;
+    std::vector<Player> players;
+    float rtt = 0;                    // Smoothed round trip to the server in seconds, 0 until measured
+    float jitter = 0;
+    ClockSync::ServerClock server_clock;
+};
+
 class LaserTagClient {
     public:
-        LaserTagClient(boost::asio::io_service &io_service, std::string hostname, std::string service_id); 
+        LaserTagClient(boost::asio::io_service &io_service, std::string hostname, std::string service_id, const Arena &arena, bool spectate, bool frontdoor); 
+
+        // UI thread interface
+        bool PollWorld();
+
+        const WorldSnapshot &World();
 
-        std::map<int, Player> &Players();
+        const Player *LocalPlayer();
+
+        const Arena &GetArena();
 
         std::pair<int, int> GetScore();
 
         int GetPlayerNum();
 
+        float Rtt();
+
+        float Jitter();
+
+        // Estimate of the tick the server is at now, negative until synchronized
+        double ServerTick();
+
         void UpdateState(Input input);
+
+        bool UpdateLaser();
     
     private:
+        // Network thread
+        void Locate();
+        void OnLocate(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<Protocol::ClientDataHeader> request);
+        void OnLocateTimeout(const boost::system::error_code &error);
+        void ReceiveRedirect();
+        void OnReceiveRedirect(const boost::system::error_code &error, size_t bytes_transmitted);
         void RequestEnterGame();
-        void OnRequestEnterGame(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<Protocol::ClientDataHeader> request);
+        void OnRequestEnterGame(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<Protocol::ClientDataHeader> request, 
+                std::shared_ptr<Protocol::JoinCookie> cookie);
         void OnEnterGameTimeout(const boost::system::error_code &error);
         void ReceiveGameData(bool initial);
-        void OnReceiveInitialGameData(const boost::system::error_code &error, size_t bytes_transmitted, 
-                std::shared_ptr<Protocol::ServerDataHeader> transmitted_data_header, std::shared_ptr<std::vector<Protocol::TransmittedData>> transmitted_data);
-        void OnReceiveGameData(const boost::system::error_code &error, size_t bytes_transmitted,
-                std::shared_ptr<Protocol::ServerDataHeader> transmitted_data_header, std::shared_ptr<std::vector<Protocol::TransmittedData>> transmitted_data);
-        void InsertOrUpdatePlayer(int player_num, Protocol::TransmittedData &data);
+        void OnReceiveInitialGameData(const boost::system::error_code &error, size_t bytes_transmitted);
+        void OnReceiveGameData(const boost::system::error_code &error, size_t bytes_transmitted);
+        void HandleEvent(const Protocol::GameEvent &event);
+        void InsertOrUpdatePlayer(const Protocol::TransmittedData &data);
+        void PublishWorld();
         void SendPlayerData(const boost::system::error_code &error);
         void OnSendPlayerData(const boost::system::error_code &error, size_t bytes_transmitted, 
                 std::shared_ptr<Protocol::ClientDataHeader> header, std::shared_ptr<Protocol::TransmittedData> data);
+
+        // UI thread
         void Laser();
-        Player &MyPlayer();
+        void PublishLocalPlayer();
+
+        Arena arena_;
+        unsigned int arena_hash_;
         boost::asio::ip::udp::socket socket_;
         boost::asio::ip::udp::endpoint endpoint_;
         boost::asio::deadline_timer timeout_timer_;
         boost::asio::deadline_timer send_timer_;
-        boost::asio::deadline_timer laser_timer_;
-        boost::asio::deadline_timer laser_available_timer_;
-        std::mutex mutex_;
+
+        // Owned by the network thread
+        alignas(16) char receive_buffer_[Protocol::kMaxDatagramSize];
+        boost::asio::ip::udp::endpoint receive_endpoint_;
+        HandlerMemory receive_handler_memory_;
         int my_player_num_;
-        std::map<int, Player> players_;
+        bool spectate_;
+        bool receiving_;
+        bool have_cookie_;
+        Protocol::JoinCookie cookie_;
+        PlayerTable players_;
         int red_score_, blue_score_;
-        int last_server_seq_num_;
+        unsigned int last_server_seq_num_;
         int seq_num_;
-        bool laser_available_;
+        bool have_local_data_;
+        SendScheduler send_scheduler_;
+        Reliability::AckTracker acks_;
+        Reliability::EventReceiver events_;
+        ClockSync::LinkTimer timing_;
+        ClockSync::ServerClock server_clock_;
+        Protocol::TransmittedData my_spawn_;
+        unsigned int my_spawn_count_;
+
+        // Owned by the UI thread
+        std::unique_ptr<Player> local_player_;
+        unsigned int applied_spawn_count_;
+        std::chrono::steady_clock::time_point laser_off_time_;
+        std::chrono::steady_clock::time_point laser_available_time_;
+
+        // Handoff between the threads
+        TripleBuffer<WorldSnapshot> world_;
+        TripleBuffer<Protocol::TransmittedData> local_data_;
 };
 
 #endif
@@ -1,31 +1,66 @@
 #include <iostream>
+#include <string>
 #include <thread>
+#include <cstdlib>
 
 #include "client.hpp"
 #include "ui.hpp"
+#include "trace.hpp"
 
 int main(int argc, char **argv) {
     try {
         if (argc < 3) {
-            std::cerr << "Usage: TeamBattleClient <remote_address> <remote_port>" << std::endl;
+            std::cerr << "Usage: TeamBattleClient <remote_address> <remote_port> [--fps <max_fps (0 = uncapped)>] [--vsync <0|1>] [--map <file>] [--spectate] [--frontdoor] [--trace <file>]" << std::endl;
             return -1;
         } else {
+            int max_fps = 60;
+            bool vsync = true;
+            std::string map_path;
+            bool spectate = false;
+            bool frontdoor = false;
+            for (int i = 3; i < argc; i++) {
+                std::string option(argv[i]);
+                if (option == "--fps" && i + 1 < argc) {
+                    max_fps = atoi(argv[++i]);
+                } else if (option == "--vsync" && i + 1 < argc) {
+                    vsync = atoi(argv[++i]) != 0;
+                } else if (option == "--map" && i + 1 < argc) {
+                    map_path = argv[++i];
+                } else if (option == "--spectate") {
+                    spectate = true;
+                } else if (option == "--trace" && i + 1 < argc) {
+                    UI::trace_path = argv[++i];
+                    Trace::Enable("LaserTagClient");
+                } else if (option == "--frontdoor") {
+                    frontdoor = true;
+                } else {
+                    std::cerr << "Unknown option " << option << std::endl;
+                    return -1;
+                }
+            }
+
             // Init io service
             boost::asio::io_service io_service;
 
             // Run network io on separate thread
-            LaserTagClient client(io_service, argv[1], argv[2]);
+            Arena arena = map_path.empty() ? Arena(-250, -250, 250, 250) : Arena::Load(map_path);
+            LaserTagClient client(io_service, argv[1], argv[2], arena, spectate, frontdoor);
             
             // Initialize client
             std::thread async_io_thread([&io_service]() {
-                io_service.run();
+                try {
+                    io_service.run();
+                } catch (std::exception &exc) {
+                    std::cerr << "Exception: " << exc.what() << std::endl;
+                    exit(-1);
+                }
             });
        
             std::cout << "Client running" << std::endl;
 
             // Initialize UI
             UI::session_ptr = std::shared_ptr<LaserTagClient>(&client);
-            UI::InitUI();
+            UI::InitUI(max_fps, vsync);
         }
     } catch (std::exception exc) {
         std::cerr << "Exception: " << exc.what() << std::endl;
@@ -0,0 +1,50 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Single producer, single consumer handoff of the latest value. The producer fills the back buffer and publishes it,
+// the consumer picks up whatever was published last. Neither side ever blocks or copies the other's data.
+template <typename T>
+class TripleBuffer {
+    public:
+        TripleBuffer() 
+            : back_(0),
+              middle_(1),
+              front_(2) {}
+
+        // Producer side: buffer to fill before publishing. Holds stale data from an earlier publish.
+        T &Back() {
+            return buffers_[back_];
+        }
+
+        // Producer side: make the back buffer the latest value and take over an unused buffer
+        void Publish() {
+            back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+        }
+
+        // Consumer side: switch to the latest published value, returns false if nothing new was published
+        bool Update() {
+            if ((middle_.load(std::memory_order_relaxed) & kFresh) == 0) {
+                return false;
+            }
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+            return true;
+        }
+
+        // Consumer side: the value picked up by the last successful Update
+        const T &Front() const {
+            return buffers_[front_];
+        }
+
+    private:
+        static const unsigned int kIndexMask = 0x3;
+        static const unsigned int kFresh = 0x4;
+
+        T buffers_[3];
+        unsigned int back_;
+        std::atomic<unsigned int> middle_;
+        unsigned int front_;
+};
+
+#endif
@@ -1,9 +1,12 @@
+#include <iostream>
 #include <algorithm>
+#include <chrono>
 #include <OpenGL/OpenGL.h>
 #include <GLUT/GLUT.h>
 
 #include "player.hpp"
 #include "client.hpp"
+#include "trace.hpp"
 
 #include "ui.hpp"
 
@@ -13,10 +16,21 @@ using namespace Protocol;
 namespace UI {
 
 std::shared_ptr<LaserTagClient> session_ptr;
+std::string trace_path;
 
 bool keys[256];
 
-void InitUI() {
+// Simulation runs on a fixed timestep so movement speed does not depend on the frame rate
+const std::chrono::microseconds kSimulationStep(1000000 / 60);
+const int kMaxStepsPerFrame = 5;
+
+std::chrono::steady_clock::time_point last_frame_time;
+std::chrono::microseconds accumulated_time(0);
+int frame_interval_ms = 0;
+bool redraw_needed = true;
+std::pair<int, int> last_score(-1, -1);
+
+void InitUI(int max_fps, bool vsync) {
     // Initialize openGL
     int argc = 1;
     char *argv[1] = {"LaserTag"};
@@ -29,85 +43,185 @@ void InitUI() {
 
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluOrtho2D(-250, 250, -250, 250);
+    const Arena &arena = session_ptr->GetArena();
+    gluOrtho2D(arena.MinX(), arena.MaxX(), arena.MinY(), arena.MaxY());
+
+    // Sync buffer swaps to the display refresh if requested
+    GLint swap_interval = vsync ? 1 : 0;
+    CGLSetParameter(CGLGetCurrentContext(), kCGLCPSwapInterval, &swap_interval);
 
     glutDisplayFunc(Render);
-    glutIdleFunc(Render);
+
+    // Drive the simulation from a timer when frames are capped, otherwise run as fast as possible
+    last_frame_time = std::chrono::steady_clock::now();
+    if (max_fps > 0) {
+        frame_interval_ms = 1000 / max_fps;
+        glutTimerFunc(frame_interval_ms, Tick, 0);
+    } else {
+        glutIdleFunc(Idle);
+    }
     
     glutIgnoreKeyRepeat(true);
     glutSpecialFunc(KeyboardDown);
     glutSpecialUpFunc(KeyboardUp);
+    glutKeyboardFunc(CharacterDown);
 
     glutMainLoop();
 }
 
-void Render() {
-    // Clear color
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   
-    // Draw
-    DrawPlayers();
-    WriteScore();
+void Tick(int value) {
+    Update();
+
+    // Schedule the next frame
+    glutTimerFunc(frame_interval_ms, Tick, 0);
+}
+
+void Idle() {
+    Update();
+}
+
+void Update() {
+    // Accumulate the real time elapsed since the last frame
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    accumulated_time += std::chrono::duration_cast<std::chrono::microseconds>(now - last_frame_time);
+    last_frame_time = now;
+
+    // Run as many fixed simulation steps as fit, dropping time if we fall too far behind
+    int steps = 0;
+    while (accumulated_time >= kSimulationStep) {
+        if (steps == kMaxStepsPerFrame) {
+            accumulated_time = std::chrono::microseconds(0);
+            break;
+        }
+        Simulate();
+        accumulated_time -= kSimulationStep;
+        steps++;
+    }
+
+    // Pick up the latest snapshot from the network
+    if (session_ptr->PollWorld()) {
+        redraw_needed = true;
+    }
+
+    // Only redraw when something changed
+    if (redraw_needed) {
+        glutPostRedisplay();
+    }
+}
+
+void Simulate() {
+    TRACE_SCOPE("Simulate");
 
     // Get controls state
     int controls[5] = {static_cast<int>(Up), static_cast<int>(Down), static_cast<int>(Left), static_cast<int>(Right), static_cast<int>(Space)};
     for (int i = 0; i < 5; i++) {
         if (keys[controls[i]]) {
             session_ptr->UpdateState(static_cast<Input>(controls[i]));
+            redraw_needed = true;
         }
     }
 
+    // Expire the laser
+    if (session_ptr->UpdateLaser()) {
+        redraw_needed = true;
+    }
+}
+
+void Render() {
+    Trace::Span span("Render");
+    span.SetArg("seq", session_ptr->World().server_seq_num);
+    redraw_needed = false;
+
+    // Clear color
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   
+    // Draw
+    DrawArena();
+    DrawPlayers();
+    WriteScore();
+
     // Swap buffers to submit
     glutSwapBuffers();
 }
 
+void DrawArena() {
+    // Obstacles in grey
+    const Arena &arena = session_ptr->GetArena();
+    glColor3f(0.5, 0.5, 0.5);
+    for (size_t i = 0; i < arena.NumObstacles(); i++) {
+        std::vector<Vector2D> vertices = arena.ObstacleVertices(i);
+        glBegin(GL_POLYGON);
+        for (const Vector2D &v : vertices) {
+            glVertex2f(v.x, v.y);
+        }
+        glEnd();
+    }
+}
+
 void DrawPlayers() {
+    TRACE_SCOPE("DrawPlayers");
+
     // Get our player number
     int my_num = session_ptr->GetPlayerNum();
 
-    // Draw triangle for each player
-    std::map<int, Player> players = session_ptr->Players();
-    for (std::pair<int, Player> k_v : players) {
-        // Player vector
-        Player &player = k_v.second;
-
-        // Color of the player
-        if (player.Team() == blue) {
-            if (player.PlayerNum() == my_num)
-                glColor3f(0.0, 1.0, 1.0); // Cyan
-            else
-                glColor3f(0.12, 0.56, 1.0); // Blue
-        } else {
-            if (player.PlayerNum() == my_num)
-                glColor3f(1.0, 0.08, 0.57); // Pink
-            else
-                glColor3f(1.0, 0.0, 0.0); // Red
+    // Draw triangle for each player, using our own predicted state for ourselves
+    const WorldSnapshot &world = session_ptr->World();
+    for (const Player &player : world.players) {
+        if (player.PlayerNum() != my_num) {
+            DrawPlayer(player, false);
         }
-        
-        // Draw body
-        std::vector<Vector2D> vertices = player.Vertices();
-        glBegin(GL_TRIANGLES);
-        for (Vector2D v : vertices) {
-            glVertex2f(v.x, v.y);
-        }
-        glEnd();
+    }
 
-        // Draw line for laser
-        if (player.Laser()) {
-            const Vector2D &pos = player.Position();
-            const Vector2D &dir = player.Direction();
-            Vector2D shot_end(pos + dir * 1000);
-            glBegin(GL_LINES);
-            glVertex2f(pos.x, pos.y);
-            glVertex2f(shot_end.x, shot_end.y);
-            glEnd();
-        }
+    const Player *local_player = session_ptr->LocalPlayer();
+    if (local_player) {
+        DrawPlayer(*local_player, true);
+    }
+}
+
+void DrawPlayer(const Player &player, bool mine) {
+    // Color of the player
+    if (player.Team() == blue) {
+        if (mine)
+            glColor3f(0.0, 1.0, 1.0); // Cyan
+        else
+            glColor3f(0.12, 0.56, 1.0); // Blue
+    } else {
+        if (mine)
+            glColor3f(1.0, 0.08, 0.57); // Pink
+        else
+            glColor3f(1.0, 0.0, 0.0); // Red
+    }
+    
+    // Draw body
+    std::vector<Vector2D> vertices = player.Vertices();
+    glBegin(GL_TRIANGLES);
+    for (Vector2D v : vertices) {
+        glVertex2f(v.x, v.y);
+    }
+    glEnd();
+
+    // Draw line for laser, up to the obstacle it hits
+    if (player.Laser()) {
+        const Vector2D &pos = player.Position();
+        const Vector2D &dir = player.Direction();
+        float length = 1000;
+        session_ptr->GetArena().RayCast(pos, dir, length);
+        Vector2D shot_end(pos + dir * std::min(length, 1000.0f));
+        glBegin(GL_LINES);
+        glVertex2f(pos.x, pos.y);
+        glVertex2f(shot_end.x, shot_end.y);
+        glEnd();
     }
 }
 
 void WriteScore() {
-    // Write score
+    // Write score only when it has changed, setting the title is expensive
     std::pair<int, int> score = session_ptr->GetScore();
+    if (score == last_score) {
+        return;
+    }
+    last_score = score;
+
     std::stringstream ss;
     ss << "Red " << score.first << " — " << score.second << " Blue";
     std::string tmp = ss.str();
@@ -124,12 +238,24 @@ void KeyboardUp(int key, int x, int y) {
     keys[key] = false;
 }
 
+void CharacterDown(unsigned char key, int x, int y) {
+    // Write the trace on request
+    if (key == 't' && Trace::Enabled()) {
+        if (Trace::Write(trace_path)) {
+            std::cout << "Wrote trace to " << trace_path << std::endl;
+        } else {
+            std::cerr << "Could not write trace to " << trace_path << std::endl;
+        }
+    }
+}
+
 void Reshape(int w, int h) {
+    const Arena &arena = session_ptr->GetArena();
     float aspect_ratio = float(w) / float(h);
     if (w >= h) {
-        gluOrtho2D(-250 * aspect_ratio, 250 * aspect_ratio, -250, 250);
+        gluOrtho2D(arena.MinX() * aspect_ratio, arena.MaxX() * aspect_ratio, arena.MinY(), arena.MaxY());
     } else {
-        gluOrtho2D(-250, 250, -250 / aspect_ratio, 250 / aspect_ratio);
+        gluOrtho2D(arena.MinX(), arena.MaxX(), arena.MinY() / aspect_ratio, arena.MaxY() / aspect_ratio);
     }
 }
 
@@ -5,18 +5,35 @@ namespace UI {
 
     extern std::shared_ptr<LaserTagClient> session_ptr;
 
-    void InitUI();
+    // Where the trace is written when T is pressed
+    extern std::string trace_path;
+
+    void InitUI(int max_fps, bool vsync);
+
+    void Tick(int value);
+
+    void Idle();
+
+    void Update();
+
+    void Simulate();
 
     void Render();
 
+    void DrawArena();
+
     void DrawPlayers();
 
+    void DrawPlayer(const Player &player, bool mine);
+
     void WriteScore();
 
     void KeyboardDown(int key, int x, int y);
 
     void KeyboardUp(int key, int x, int y);
 
+    void CharacterDown(unsigned char key, int x, int y);
+
     void Reshape(int w, int h);
 }
 
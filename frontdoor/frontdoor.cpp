@@ -0,0 +1,144 @@
+#include <iostream>
+#include <boost/bind.hpp>
+
+#include "frontdoor.hpp"
+#include "packet_view.hpp"
+
+using namespace Protocol;
+
+namespace {
+
+// Servers report every second, one that misses a few is taken out of rotation
+const std::chrono::seconds kServerTimeout(3);
+
+// Servers spending more than this much of their tick working only get joins if every server does
+const float kMaxTickLoad = 0.8;
+
+// Most servers kept in rotation, reports from further servers are ignored until some stop reporting
+const size_t kMaxServers = 1024;
+
+bool SameCookie(const JoinCookie &a, const JoinCookie &b) {
+    return a.mac[0] == b.mac[0] && a.mac[1] == b.mac[1];
+}
+
+}
+
+LaserTagFrontDoor::LaserTagFrontDoor(boost::asio::io_service &io_service, short port, const std::string &key, bool quiet) 
+    : socket_(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port)),
+      key_(key),
+      quiet_(quiet) {
+    Receive();
+}
+
+void LaserTagFrontDoor::Receive() {
+    socket_.async_receive_from(boost::asio::buffer(buffer_), sender_, MakeCustomAllocHandler(handler_memory_, 
+            [this](const boost::system::error_code &error, size_t bytes_transferred) { OnReceive(error, bytes_transferred); }));
+}
+
+void LaserTagFrontDoor::OnReceive(const boost::system::error_code &error, size_t bytes_transferred) {
+    ClientPacketView packet;
+    if (!error && packet.Parse(buffer_, bytes_transferred)) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (packet.Header().request == server_report && bytes_transferred >= sizeof(ClientDataHeader) + sizeof(ServerLoad) + sizeof(ReportAuth)) {
+            OnReport(now);
+        } else if (packet.Header().request == locate_request) {
+            OnLocate(now);
+        }
+    }
+
+    // Receive next
+    Receive();
+}
+
+void LaserTagFrontDoor::OnReport(std::chrono::steady_clock::time_point now) {
+    // Reports without the key get no answer at all
+    const ServerLoad &load = *reinterpret_cast<const ServerLoad *>(buffer_ + sizeof(ClientDataHeader));
+    const ReportAuth &auth = *reinterpret_cast<const ReportAuth *>(buffer_ + sizeof(ClientDataHeader) + sizeof(ServerLoad));
+    if (!key_.Verify(buffer_, auth)) {
+        return;
+    }
+
+    // Signed reports can be replayed from elsewhere, so the sender also has to echo a cookie for its endpoint. It gets 
+    // a fresh one whenever it is not using the current one, and counts as long as the old one is still valid.
+    JoinCookie current = cookies_.Issue(sender_, server_report, now);
+    if (!SameCookie(auth.cookie, current)) {
+        JoinChallenge challenge;
+        challenge.version = kVersion;
+        challenge.client_player_num = kChallengePlayerNum;
+        challenge.cookie = current;
+        challenge.arena_hash = 0;
+        boost::system::error_code ignored;
+        socket_.send_to(boost::asio::buffer(&challenge, sizeof(JoinChallenge)), sender_, 0, ignored);
+        if (!cookies_.Verify(sender_, server_report, auth.cookie, now)) {
+            return;
+        }
+    }
+
+    auto iter = servers_.find(sender_);
+    if (iter == servers_.end()) {
+        ForgetStale(now);
+        if (servers_.size() >= kMaxServers) {
+            return;
+        }
+        if (!quiet_) {
+            std::cout << "Server at " << sender_.address() << ":" << sender_.port() << " registered" << std::endl;
+        }
+        iter = servers_.insert(std::make_pair(sender_, ServerEntry())).first;
+    }
+    iter->second.load = load;
+    iter->second.last_report = now;
+}
+
+void LaserTagFrontDoor::ForgetStale(std::chrono::steady_clock::time_point now) {
+    for (auto iter = servers_.begin(); iter != servers_.end(); /* Not while deleting */) {
+        if (now - iter->second.last_report > kServerTimeout) {
+            if (!quiet_) {
+                std::cout << "Server at " << iter->first.address() << ":" << iter->first.port() << " stopped reporting" << std::endl;
+            }
+            servers_.erase(iter++);
+        } else {
+            iter++;
+        }
+    }
+}
+
+void LaserTagFrontDoor::OnLocate(std::chrono::steady_clock::time_point now) {
+    // Forget servers that stopped reporting, and pick the one with the fewest players that has tick time to spare,
+    // falling back to the least busy one
+    ForgetStale(now);
+    auto best = servers_.end();
+    for (auto iter = servers_.begin(); iter != servers_.end(); iter++) {
+        if (best == servers_.end()) {
+            best = iter;
+        } else {
+            const ServerLoad &load = iter->second.load;
+            const ServerLoad &best_load = best->second.load;
+            bool headroom = load.tick_load < kMaxTickLoad;
+            bool best_headroom = best_load.tick_load < kMaxTickLoad;
+            if (headroom != best_headroom) {
+                if (headroom) {
+                    best = iter;
+                }
+            } else if (headroom ? load.num_players < best_load.num_players : load.tick_load < best_load.tick_load) {
+                best = iter;
+            }
+        }
+    }
+    if (best == servers_.end()) {
+        // Nowhere to send them, the client asks again
+        return;
+    }
+
+    // Count the join in now, so a burst of clients between reports is spread out
+    best->second.load.num_players++;
+
+    std::shared_ptr<Redirect> redirect(new Redirect());
+    redirect->version = kVersion;
+    redirect->address = best->first.address().to_v4().to_ulong();
+    redirect->port = best->first.port();
+    socket_.async_send_to(boost::asio::buffer(redirect.get(), sizeof(Redirect)), sender_, boost::bind(&LaserTagFrontDoor::OnSend, this, _1, _2, redirect));
+}
+
+void LaserTagFrontDoor::OnSend(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<Redirect> redirect) {
+    // Method maintains ownership of the redirect until async send has completed
+}
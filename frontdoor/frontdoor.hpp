@@ -0,0 +1,42 @@
+#ifndef FRONTDOOR_H
+#define FRONTDOOR_H
+
+#include <map>
+#include <chrono>
+#include <boost/asio.hpp>
+
+#include "protocol.hpp"
+#include "handler_allocator.hpp"
+#include "join_cookies.hpp"
+
+// Game server known to the front door through its load reports
+struct ServerEntry {
+    Protocol::ServerLoad load;
+    std::chrono::steady_clock::time_point last_report;
+};
+
+// Takes load reports from game servers and answers clients' locate requests with a redirect to the least loaded one.
+// Reports count once they are signed with the shared key and echo a cookie for the endpoint they come from.
+class LaserTagFrontDoor {
+    public:
+        LaserTagFrontDoor(boost::asio::io_service &io_service, short port, const std::string &key, bool quiet);
+
+    private:
+        void Receive();
+        void OnReceive(const boost::system::error_code &error, size_t bytes_transferred);
+        void OnReport(std::chrono::steady_clock::time_point now);
+        void ForgetStale(std::chrono::steady_clock::time_point now);
+        void OnLocate(std::chrono::steady_clock::time_point now);
+        void OnSend(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<Protocol::Redirect> redirect);
+
+        boost::asio::ip::udp::socket socket_;
+        alignas(16) char buffer_[Protocol::kMaxDatagramSize];
+        boost::asio::ip::udp::endpoint sender_;
+        HandlerMemory handler_memory_;
+        std::map<boost::asio::ip::udp::endpoint, ServerEntry> servers_;
+        ReportKey key_;
+        JoinCookies cookies_;
+        bool quiet_;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#include <iostream>
+#include <string>
+
+#include "frontdoor.hpp"
+
+int main(int argc, char **argv) {
+    
+    try {
+        if (argc < 3) {
+            std::cerr << "Usage: LaserTagFrontDoor <port> <key> [--quiet]" << std::endl;
+            return -1;
+        } else {
+            bool quiet = false;
+            for (int i = 3; i < argc; i++) {
+                std::string option(argv[i]);
+                if (option == "--quiet") {
+                    quiet = true;
+                } else {
+                    std::cerr << "Unknown option " << option << std::endl;
+                    return -1;
+                }
+            }
+
+            boost::asio::io_service io_service;
+            LaserTagFrontDoor frontdoor(io_service, atoi(argv[1]), argv[2], quiet);
+            std::cout << "Front door running" << std::endl;
+            io_service.run();
+        }
+    } catch (std::exception &exc) {
+        std::cerr << "Exception: " << exc.what() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,310 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+#include "arena.hpp"
+
+using namespace Geometry;
+
+namespace {
+
+// Slab test of the ray against a box, limited to distances up to t_max
+bool RayHitsBox(float min_x, float min_y, float max_x, float max_y, const Vector2D &point, const Vector2D &inv_direction, float t_max) {
+    float tx0 = (min_x - point.x) * inv_direction.x;
+    float tx1 = (max_x - point.x) * inv_direction.x;
+    float ty0 = (min_y - point.y) * inv_direction.y;
+    float ty1 = (max_y - point.y) * inv_direction.y;
+    float t_enter = std::max(std::min(tx0, tx1), std::min(ty0, ty1));
+    float t_exit = std::min(std::max(tx0, tx1), std::max(ty0, ty1));
+    return t_exit >= std::max(t_enter, 0.0f) && t_enter <= t_max;
+}
+
+void HashBytes(unsigned int &hash, const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+}
+
+bool CircleOverlapsBox(float min_x, float min_y, float max_x, float max_y, const Vector2D &center, float radius) {
+    return center.x + radius >= min_x && center.x - radius <= max_x && center.y + radius >= min_y && center.y - radius <= max_y;
+}
+
+}
+
+Arena::Arena(float min_x, float min_y, float max_x, float max_y) 
+    : min_x_(min_x),
+      min_y_(min_y),
+      max_x_(max_x),
+      max_y_(max_y) {}
+
+Arena Arena::Load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open map " + path);
+    }
+
+    Arena arena(-250, -250, 250, 250);
+    std::string line;
+    for (int line_num = 1; std::getline(file, line); line_num++) {
+        std::istringstream tokens(line);
+        std::string keyword;
+        if (!(tokens >> keyword) || keyword[0] == '#') {
+            // Blank line or comment
+            continue;
+        }
+
+        if (keyword == "bounds") {
+            if (!(tokens >> arena.min_x_ >> arena.min_y_ >> arena.max_x_ >> arena.max_y_) || arena.min_x_ >= arena.max_x_ || arena.min_y_ >= arena.max_y_) {
+                throw std::runtime_error(path + ":" + std::to_string(line_num) + ": bad bounds");
+            }
+        } else if (keyword == "obstacle") {
+            std::vector<Vector2D> vertices;
+            float x, y;
+            while (tokens >> x >> y) {
+                vertices.push_back(Vector2D(x, y));
+            }
+            if (!tokens.eof() || vertices.size() < 3) {
+                throw std::runtime_error(path + ":" + std::to_string(line_num) + ": obstacle needs at least 3 vertices");
+            }
+            try {
+                arena.AddObstacle(vertices);
+            } catch (std::runtime_error &exc) {
+                throw std::runtime_error(path + ":" + std::to_string(line_num) + ": " + exc.what());
+            }
+        } else {
+            throw std::runtime_error(path + ":" + std::to_string(line_num) + ": unknown keyword " + keyword);
+        }
+    }
+
+    arena.Build();
+    return arena;
+}
+
+void Arena::AddObstacle(std::vector<Vector2D> vertices) {
+    // Store counter-clockwise so edge normals point outwards
+    if (SignedArea(vertices) < 0.0) {
+        std::reverse(vertices.begin(), vertices.end());
+    }
+
+    // Every turn must go the same way for the polygon to be convex
+    for (size_t i = 0; i < vertices.size(); i++) {
+        Vector2D e0 = vertices[(i + 1) % vertices.size()] - vertices[i];
+        Vector2D e1 = vertices[(i + 2) % vertices.size()] - vertices[(i + 1) % vertices.size()];
+        if (e0.x * e1.y - e0.y * e1.x < 0.0) {
+            throw std::runtime_error("Obstacle is not convex");
+        }
+    }
+
+    Obstacle obstacle;
+    obstacle.first_vertex = vertices_.size();
+    obstacle.num_vertices = vertices.size();
+    obstacle.min_x = obstacle.max_x = vertices[0].x;
+    obstacle.min_y = obstacle.max_y = vertices[0].y;
+    for (const Vector2D &v : vertices) {
+        obstacle.min_x = std::min(obstacle.min_x, v.x);
+        obstacle.min_y = std::min(obstacle.min_y, v.y);
+        obstacle.max_x = std::max(obstacle.max_x, v.x);
+        obstacle.max_y = std::max(obstacle.max_y, v.y);
+        vertices_.push_back(v);
+    }
+    obstacles_.push_back(obstacle);
+}
+
+void Arena::Build() {
+    obstacle_order_.clear();
+    nodes_.clear();
+    for (size_t i = 0; i < obstacles_.size(); i++) {
+        obstacle_order_.push_back(i);
+    }
+
+    if (!obstacles_.empty()) {
+        nodes_.reserve(2 * obstacles_.size());
+        BuildNode(0, obstacles_.size());
+    }
+}
+
+int Arena::BuildNode(size_t begin, size_t end) {
+    // Bounds of the obstacles and of their centers
+    int index = nodes_.size();
+    nodes_.push_back(Node());
+    Node node;
+    node.min_x = node.min_y = std::numeric_limits<float>::max();
+    node.max_x = node.max_y = -std::numeric_limits<float>::max();
+    float c_min_x = node.min_x, c_min_y = node.min_y, c_max_x = node.max_x, c_max_y = node.max_y;
+    for (size_t i = begin; i < end; i++) {
+        const Obstacle &obstacle = obstacles_[obstacle_order_[i]];
+        node.min_x = std::min(node.min_x, obstacle.min_x);
+        node.min_y = std::min(node.min_y, obstacle.min_y);
+        node.max_x = std::max(node.max_x, obstacle.max_x);
+        node.max_y = std::max(node.max_y, obstacle.max_y);
+        float c_x = 0.5 * (obstacle.min_x + obstacle.max_x);
+        float c_y = 0.5 * (obstacle.min_y + obstacle.max_y);
+        c_min_x = std::min(c_min_x, c_x);
+        c_min_y = std::min(c_min_y, c_y);
+        c_max_x = std::max(c_max_x, c_x);
+        c_max_y = std::max(c_max_y, c_y);
+    }
+
+    if (end - begin <= kMaxLeafObstacles) {
+        // Small enough to test directly
+        node.right_child = -1;
+        node.first_obstacle = begin;
+        node.num_obstacles = end - begin;
+    } else {
+        // Split at the median center along the longest axis
+        bool split_x = c_max_x - c_min_x > c_max_y - c_min_y;
+        size_t middle = begin + (end - begin) / 2;
+        std::nth_element(obstacle_order_.begin() + begin, obstacle_order_.begin() + middle, obstacle_order_.begin() + end, 
+            [this, split_x](int lhs, int rhs) {
+                const Obstacle &a = obstacles_[lhs];
+                const Obstacle &b = obstacles_[rhs];
+                return split_x ? a.min_x + a.max_x < b.min_x + b.max_x : a.min_y + a.max_y < b.min_y + b.max_y;
+            });
+
+        node.first_obstacle = 0;
+        node.num_obstacles = 0;
+        BuildNode(begin, middle);
+        node.right_child = BuildNode(middle, end);
+    }
+
+    nodes_[index] = node;
+    return index;
+}
+
+bool Arena::RayCast(const Vector2D &point, const Vector2D &direction, float &t_hit) const {
+    // Walk the hierarchy, only descending into boxes the ray reaches before the nearest hit so far
+    float t_best = std::numeric_limits<float>::max();
+    Vector2D inv_direction(1.0 / direction.x, 1.0 / direction.y);
+    int stack[kMaxDepth];
+    int stack_size = 0;
+    if (!nodes_.empty()) {
+        stack[stack_size++] = 0;
+    }
+
+    while (stack_size > 0) {
+        const Node &node = nodes_[stack[--stack_size]];
+        if (!RayHitsBox(node.min_x, node.min_y, node.max_x, node.max_y, point, inv_direction, t_best)) {
+            continue;
+        }
+
+        if (node.right_child < 0) {
+            for (int i = node.first_obstacle; i < node.first_obstacle + node.num_obstacles; i++) {
+                const Obstacle &obstacle = obstacles_[obstacle_order_[i]];
+                float t;
+                if (RayIntersectsConvexPolygon(&vertices_[obstacle.first_vertex], obstacle.num_vertices, point, direction, t) && t < t_best) {
+                    t_best = t;
+                }
+            }
+        } else {
+            stack[stack_size++] = node.right_child;
+            stack[stack_size++] = &node - &nodes_[0] + 1;
+        }
+    }
+
+    t_hit = t_best;
+    return t_best != std::numeric_limits<float>::max();
+}
+
+bool Arena::Collides(const Vector2D &center, float radius) const {
+    // Leaving the arena counts as a collision
+    if (center.x - radius < min_x_ || center.x + radius > max_x_ || center.y - radius < min_y_ || center.y + radius > max_y_) {
+        return true;
+    }
+
+    int stack[kMaxDepth];
+    int stack_size = 0;
+    if (!nodes_.empty()) {
+        stack[stack_size++] = 0;
+    }
+
+    while (stack_size > 0) {
+        const Node &node = nodes_[stack[--stack_size]];
+        if (!CircleOverlapsBox(node.min_x, node.min_y, node.max_x, node.max_y, center, radius)) {
+            continue;
+        }
+
+        if (node.right_child < 0) {
+            for (int i = node.first_obstacle; i < node.first_obstacle + node.num_obstacles; i++) {
+                const Obstacle &obstacle = obstacles_[obstacle_order_[i]];
+                if (!CircleOverlapsBox(obstacle.min_x, obstacle.min_y, obstacle.max_x, obstacle.max_y, center, radius)) {
+                    continue;
+                }
+
+                // Inside, or close enough to an edge
+                const Vector2D *verts = &vertices_[obstacle.first_vertex];
+                if (PointInConvexPolygon(verts, obstacle.num_vertices, center)) {
+                    return true;
+                }
+                for (size_t v = 0, u = obstacle.num_vertices - 1; v < obstacle.num_vertices; u = v, v++) {
+                    if (DistanceToSegment(center, verts[u], verts[v]) < radius) {
+                        return true;
+                    }
+                }
+            }
+        } else {
+            stack[stack_size++] = node.right_child;
+            stack[stack_size++] = &node - &nodes_[0] + 1;
+        }
+    }
+
+    return false;
+}
+
+bool Arena::ValidSpawn(const Vector2D &point, float radius) const {
+    return !Collides(point, radius);
+}
+
+bool Arena::FindSpawn(float radius, Vector2D &point) const {
+    for (float y = min_y_ + radius; y <= max_y_ - radius; y += radius) {
+        for (float x = min_x_ + radius; x <= max_x_ - radius; x += radius) {
+            if (ValidSpawn(Vector2D(x, y), radius)) {
+                point = Vector2D(x, y);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+float Arena::MinX() const {
+    return min_x_;
+}
+
+float Arena::MinY() const {
+    return min_y_;
+}
+
+float Arena::MaxX() const {
+    return max_x_;
+}
+
+float Arena::MaxY() const {
+    return max_y_;
+}
+
+size_t Arena::NumObstacles() const {
+    return obstacles_.size();
+}
+
+std::vector<Vector2D> Arena::ObstacleVertices(size_t obstacle) const {
+    const Obstacle &o = obstacles_[obstacle];
+    return std::vector<Vector2D>(vertices_.begin() + o.first_vertex, vertices_.begin() + o.first_vertex + o.num_vertices);
+}
+
+unsigned int Arena::Hash() const {
+    unsigned int hash = 2166136261u;
+    float bounds[4] = {min_x_, min_y_, max_x_, max_y_};
+    HashBytes(hash, bounds, sizeof(bounds));
+    for (const Obstacle &obstacle : obstacles_) {
+        unsigned int num_vertices = obstacle.num_vertices;
+        HashBytes(hash, &num_vertices, sizeof(num_vertices));
+        for (size_t i = obstacle.first_vertex; i < obstacle.first_vertex + obstacle.num_vertices; i++) {
+            float vertex[2] = {vertices_[i].x, vertices_[i].y};
+            HashBytes(hash, vertex, sizeof(vertex));
+        }
+    }
+    return hash;
+}
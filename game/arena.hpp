@@ -0,0 +1,75 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <string>
+#include <vector>
+
+#include "geometry.hpp"
+
+// Static map of convex obstacles inside a rectangular boundary. Obstacles are indexed by a bounding volume
+// hierarchy built at load time, which answers laser ray casts, movement collision and spawn validity.
+class Arena {
+    public:
+        // Empty arena with the given bounds
+        Arena(float min_x, float min_y, float max_x, float max_y);
+
+        // Map file of "bounds <min_x> <min_y> <max_x> <max_y>" and "obstacle <x> <y> <x> <y> ..." lines, throws on bad input
+        static Arena Load(const std::string &path);
+
+        void AddObstacle(std::vector<Geometry::Vector2D> vertices);
+
+        void Build();
+
+        bool RayCast(const Geometry::Vector2D &point, const Geometry::Vector2D &direction, float &t_hit) const;
+
+        bool Collides(const Geometry::Vector2D &center, float radius) const;
+
+        bool ValidSpawn(const Geometry::Vector2D &point, float radius) const;
+
+        // First valid spawn point on a grid with the radius as spacing, scanning rows from the minimum corner. False if
+        // there is none.
+        bool FindSpawn(float radius, Geometry::Vector2D &point) const;
+
+        float MinX() const;
+
+        float MinY() const;
+
+        float MaxX() const;
+
+        float MaxY() const;
+
+        size_t NumObstacles() const;
+
+        std::vector<Geometry::Vector2D> ObstacleVertices(size_t obstacle) const;
+
+        // FNV-1a of the bounds and obstacles, equal for arenas loaded from the same map
+        unsigned int Hash() const;
+
+    private:
+        struct Obstacle {
+            size_t first_vertex;
+            size_t num_vertices;
+            float min_x, min_y, max_x, max_y;
+        };
+
+        // Leaves hold a range of obstacle_order_, interior nodes have their left child right after them
+        struct Node {
+            float min_x, min_y, max_x, max_y;
+            int right_child;
+            int first_obstacle;
+            int num_obstacles;
+        };
+
+        int BuildNode(size_t begin, size_t end);
+
+        static const int kMaxLeafObstacles = 4;
+        static const int kMaxDepth = 64;
+
+        float min_x_, min_y_, max_x_, max_y_;
+        std::vector<Geometry::Vector2D> vertices_;
+        std::vector<Obstacle> obstacles_;
+        std::vector<int> obstacle_order_;
+        std::vector<Node> nodes_;
+};
+
+#endif
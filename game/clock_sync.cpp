@@ -0,0 +1,179 @@
+#include <cmath>
+
+#include "clock_sync.hpp"
+
+namespace ClockSync {
+
+namespace {
+
+// Echoes claiming a longer round trip than this are stale or garbage
+const float kMaxRtt = 10.0;
+
+// Fraction of the way the offset moves towards the best recent sample per sample
+const double kOffsetGain = 0.1;
+
+const double kWrap = 4294967296.0;
+
+// How far an offset sample is from the estimate, taking the shorter way around the 2^32 wrap
+double OffsetError(int32_t sample, double offset) {
+    double whole = std::floor(offset);
+    int32_t whole_error = static_cast<int32_t>(static_cast<uint32_t>(sample) - static_cast<uint32_t>(static_cast<int64_t>(whole)));
+    return whole_error - (offset - whole);
+}
+
+}
+
+unsigned int Millis(Clock::time_point time) {
+    return static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+}
+
+LinkTimer::LinkTimer() 
+    : have_echo_(false),
+      peer_send_time_(0),
+      have_rtt_(false),
+      rtt_(0.0),
+      jitter_(0.0),
+      last_sample_(0.0) {
+}
+
+bool LinkTimer::OnReceived(unsigned int peer_send_time, unsigned int echo_time, unsigned int echo_delay, Clock::time_point now) {
+    // Echo the peer's newest time, late packets would make our echoes look older than they are
+    if (!have_echo_ || static_cast<int>(peer_send_time - peer_send_time_) >= 0) {
+        have_echo_ = true;
+        peer_send_time_ = peer_send_time;
+        peer_received_ = now;
+    }
+    if (echo_delay == kNoEcho) {
+        return false;
+    }
+
+    // Time since we sent the echoed packet, less the time the peer held it
+    float sample = static_cast<int>(Millis(now) - echo_time - echo_delay) / 1000.0;
+    if (sample < 0 || sample > kMaxRtt) {
+        return false;
+    }
+    last_sample_ = sample;
+
+    // Smooth as TCP does, the deviation is the jitter
+    if (!have_rtt_) {
+        have_rtt_ = true;
+        rtt_ = sample;
+        jitter_ = sample / 2;
+    } else {
+        jitter_ = 0.75 * jitter_ + 0.25 * std::fabs(rtt_ - sample);
+        rtt_ = 0.875 * rtt_ + 0.125 * sample;
+    }
+    return true;
+}
+
+void LinkTimer::Stamp(Clock::time_point now, unsigned int &send_time, unsigned int &echo_time, unsigned int &echo_delay) const {
+    send_time = Millis(now);
+    if (have_echo_) {
+        echo_time = peer_send_time_;
+        echo_delay = Millis(now) - Millis(peer_received_);
+    } else {
+        echo_time = 0;
+        echo_delay = kNoEcho;
+    }
+}
+
+bool LinkTimer::HaveRtt() const {
+    return have_rtt_;
+}
+
+float LinkTimer::Rtt() const {
+    return rtt_;
+}
+
+float LinkTimer::Jitter() const {
+    return jitter_;
+}
+
+float LinkTimer::LastSample() const {
+    return last_sample_;
+}
+
+ServerClock::ServerClock() 
+    : num_samples_(0),
+      next_sample_(0),
+      have_offset_(false),
+      offset_(0.0),
+      have_tick_(false),
+      first_tick_(0),
+      first_time_(0),
+      anchor_tick_(0),
+      anchor_time_(0),
+      tick_interval_ms_(0.0) {
+}
+
+void ServerClock::OnTick(unsigned int server_tick, unsigned int server_time) {
+    if (!have_tick_) {
+        have_tick_ = true;
+        first_tick_ = anchor_tick_ = server_tick;
+        first_time_ = anchor_time_ = server_time;
+        return;
+    }
+
+    // Packets of older ticks arriving late say nothing new
+    if (static_cast<int>(server_tick - anchor_tick_) <= 0) {
+        return;
+    }
+    anchor_tick_ = server_tick;
+    anchor_time_ = server_time;
+    tick_interval_ms_ = static_cast<double>(server_time - first_time_) / (server_tick - first_tick_);
+}
+
+void ServerClock::OnRttSample(unsigned int server_time, float rtt, Clock::time_point now) {
+    // The packet left the server about half an RTT before it arrived
+    OffsetSample &sample = samples_[next_sample_];
+    sample.rtt = rtt;
+    sample.offset = static_cast<int32_t>(server_time - Millis(now) + static_cast<unsigned int>(std::lround(rtt * 500)));
+    next_sample_ = (next_sample_ + 1) % kSampleWindow;
+    if (num_samples_ < kSampleWindow) {
+        num_samples_++;
+    }
+
+    // Queueing only ever adds delay, so the fastest recent round trip is the most symmetric one
+    const OffsetSample *best = &samples_[0];
+    for (int i = 1; i < num_samples_; i++) {
+        if (samples_[i].rtt < best->rtt) {
+            best = &samples_[i];
+        }
+    }
+    if (!have_offset_) {
+        have_offset_ = true;
+        offset_ = best->offset;
+    } else {
+        offset_ += kOffsetGain * OffsetError(best->offset, offset_);
+        if (offset_ >= kWrap / 2) {
+            offset_ -= kWrap;
+        } else if (offset_ < -kWrap / 2) {
+            offset_ += kWrap;
+        }
+    }
+}
+
+bool ServerClock::Synchronized() const {
+    return have_offset_ && tick_interval_ms_ > 0;
+}
+
+double ServerClock::Offset() const {
+    return offset_;
+}
+
+unsigned int ServerClock::ServerTime(Clock::time_point now) const {
+    return Millis(now) + static_cast<unsigned int>(std::llround(offset_));
+}
+
+double ServerClock::ServerTick(Clock::time_point now) const {
+    if (!Synchronized()) {
+        return anchor_tick_;
+    }
+    return anchor_tick_ + static_cast<int>(ServerTime(now) - anchor_time_) / tick_interval_ms_;
+}
+
+float ServerClock::TickInterval() const {
+    return tick_interval_ms_ / 1000.0;
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <chrono>
+#include <cstdint>
+
+namespace ClockSync {
+
+typedef std::chrono::steady_clock Clock;
+
+// Value of echo_delay when nothing has been received from the peer yet
+const unsigned int kNoEcho = 0xFFFFFFFF;
+
+// Local steady clock in milliseconds, wrapping at 2^32, differences of nearby times stay correct across the wrap
+unsigned int Millis(Clock::time_point time);
+
+// Ping and pong piggybacked on the packets of one side of a link. Outgoing packets carry our time, the latest time
+// received from the peer and how long we held it, so every echo gives an RTT sample that leaves out the peer's
+// processing and send interval. The two clocks never need to agree.
+class LinkTimer {
+    public:
+        LinkTimer();
+
+        // Returns true if the packet's echo gave an RTT sample
+        bool OnReceived(unsigned int peer_send_time, unsigned int echo_time, unsigned int echo_delay, Clock::time_point now);
+
+        void Stamp(Clock::time_point now, unsigned int &send_time, unsigned int &echo_time, unsigned int &echo_delay) const;
+
+        bool HaveRtt() const;
+
+        // Smoothed round trip time and its mean deviation, in seconds
+        float Rtt() const;
+
+        float Jitter() const;
+
+        float LastSample() const;
+
+    private:
+        bool have_echo_;
+        unsigned int peer_send_time_;
+        Clock::time_point peer_received_;
+        bool have_rtt_;
+        float rtt_, jitter_, last_sample_;
+};
+
+// Client's estimate of the server's clock and tick. The offset to the server clock comes from the lowest RTT sample
+// among the recent ones, whose half RTT guess is least wrong, and is slewed towards rather than jumped to. The tick
+// interval is measured over everything received so far, so it follows the server's actual rate.
+class ServerClock {
+    public:
+        ServerClock();
+
+        void OnTick(unsigned int server_tick, unsigned int server_time);
+
+        void OnRttSample(unsigned int server_time, float rtt, Clock::time_point now);
+
+        bool Synchronized() const;
+
+        // Milliseconds from our clock to the server's, modulo 2^32 like the clocks themselves. Steady clocks count from 
+        // boot, so this is about the difference in uptime and needs more precision than a float has.
+        double Offset() const;
+
+        unsigned int ServerTime(Clock::time_point now) const;
+
+        // Tick the server is at now, the fraction is how far into the tick it is
+        double ServerTick(Clock::time_point now) const;
+
+        // Seconds between server ticks
+        float TickInterval() const;
+
+    private:
+        static const int kSampleWindow = 16;
+
+        struct OffsetSample {
+            float rtt;
+            int32_t offset;
+        };
+
+        OffsetSample samples_[kSampleWindow];
+        int num_samples_, next_sample_;
+        bool have_offset_;
+        double offset_;  // In [-2^31, 2^31)
+
+        bool have_tick_;
+        unsigned int first_tick_, first_time_;
+        unsigned int anchor_tick_, anchor_time_;
+        double tick_interval_ms_;
+};
+
+}
+
+#endif
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "geometry.hpp"
 
 namespace Geometry {
@@ -40,10 +42,15 @@ float Norm(const Vector2D &vec) {
 }
 
 bool VectorIntersectsConvexPolygon(const std::vector<Vector2D> &poly_verts, const Vector2D &point, const Vector2D &direction) {
+    float t_hit;
+    return RayIntersectsConvexPolygon(poly_verts.data(), poly_verts.size(), point, direction, t_hit);
+}
+
+bool RayIntersectsConvexPolygon(const Vector2D *poly_verts, size_t num_verts, const Vector2D &point, const Vector2D &direction, float &t_hit) {
     float t_near = 0.0;
     float t_far = std::numeric_limits<float>::max();
 
-    for (int i = 0, j = poly_verts.size() - 1; i < poly_verts.size(); j = i, i++) {
+    for (size_t i = 0, j = num_verts - 1; i < num_verts; j = i, i++) {
         const Vector2D &e0 = poly_verts[j];
         const Vector2D &e1 = poly_verts[i];
         Vector2D e = e1 - e0;
@@ -52,6 +59,13 @@ bool VectorIntersectsConvexPolygon(const std::vector<Vector2D> &poly_verts, cons
         float numer = Dot(d, e_normal);
         float denom = Dot(direction, e_normal);
 
+        if (denom == 0.0) {
+            // Parallel to the edge, misses if outside of it
+            if (numer < 0.0)
+                return false;
+            continue;
+        }
+
         float t_clip = numer / denom;
         if (denom < 0.0) {
             if (t_clip > t_far)
@@ -66,7 +80,35 @@ bool VectorIntersectsConvexPolygon(const std::vector<Vector2D> &poly_verts, cons
         }
     }
 
+    t_hit = t_near;
     return true;
 }
 
+bool PointInConvexPolygon(const Vector2D *poly_verts, size_t num_verts, const Vector2D &point) {
+    for (size_t i = 0, j = num_verts - 1; i < num_verts; j = i, i++) {
+        Vector2D e = poly_verts[i] - poly_verts[j];
+        if (Dot(point - poly_verts[j], Vector2D(e.y, -e.x)) > 0.0)
+            return false;
+    }
+
+    return true;
+}
+
+float DistanceToSegment(const Vector2D &point, const Vector2D &e0, const Vector2D &e1) {
+    Vector2D e = e1 - e0;
+    float length_sq = Dot(e, e);
+    float t = length_sq > 0.0 ? Dot(point - e0, e) / length_sq : 0.0;
+    t = std::max(0.0f, std::min(1.0f, t));
+    return Norm(point - (e0 + e * t));
+}
+
+float SignedArea(const std::vector<Vector2D> &poly_verts) {
+    float area = 0.0;
+    for (size_t i = 0, j = poly_verts.size() - 1; i < poly_verts.size(); j = i, i++) {
+        area += poly_verts[j].x * poly_verts[i].y - poly_verts[i].x * poly_verts[j].y;
+    }
+
+    return area;
+}
+
 }
@@ -31,6 +31,16 @@ float Norm(const Vector2D &vec);
 
 bool VectorIntersectsConvexPolygon(const std::vector<Vector2D> &poly_verts, const Vector2D &point, const Vector2D &direction);
 
+// Counter-clockwise convex polygon hit by the ray, t_hit is the distance along direction where it enters
+bool RayIntersectsConvexPolygon(const Vector2D *poly_verts, size_t num_verts, const Vector2D &point, const Vector2D &direction, float &t_hit);
+
+bool PointInConvexPolygon(const Vector2D *poly_verts, size_t num_verts, const Vector2D &point);
+
+float DistanceToSegment(const Vector2D &point, const Vector2D &e0, const Vector2D &e1);
+
+// Twice the signed area, positive for counter-clockwise winding
+float SignedArea(const std::vector<Vector2D> &poly_verts);
+
 }
 
 #endif
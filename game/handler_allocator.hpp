@@ -0,0 +1,104 @@
+#ifndef HANDLER_ALLOCATOR_H
+#define HANDLER_ALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Fixed block of memory reused for the operation state of one outstanding asynchronous call at a time,
+// falling back to the heap if a second allocation is requested while the block is in use
+class HandlerMemory {
+    public:
+        HandlerMemory() 
+            : in_use_(false) {}
+
+        HandlerMemory(const HandlerMemory &) = delete;
+        HandlerMemory &operator=(const HandlerMemory &) = delete;
+
+        void *Allocate(std::size_t size) {
+            if (!in_use_ && size <= sizeof(storage_)) {
+                in_use_ = true;
+                return &storage_;
+            }
+            return ::operator new(size);
+        }
+
+        void Deallocate(void *pointer) {
+            if (pointer == &storage_) {
+                in_use_ = false;
+            } else {
+                ::operator delete(pointer);
+            }
+        }
+
+    private:
+        typename std::aligned_storage<1024>::type storage_;
+        bool in_use_;
+};
+
+// Standard allocator handing out a HandlerMemory block
+template <typename T>
+class HandlerAllocator {
+    public:
+        typedef T value_type;
+
+        explicit HandlerAllocator(HandlerMemory &memory) 
+            : memory_(memory) {}
+
+        template <typename U>
+        HandlerAllocator(const HandlerAllocator<U> &other) 
+            : memory_(other.memory_) {}
+
+        T *allocate(std::size_t n) const {
+            return static_cast<T *>(memory_.Allocate(sizeof(T) * n));
+        }
+
+        void deallocate(T *pointer, std::size_t) const {
+            memory_.Deallocate(pointer);
+        }
+
+        bool operator==(const HandlerAllocator &other) const {
+            return &memory_ == &other.memory_;
+        }
+
+        bool operator!=(const HandlerAllocator &other) const {
+            return &memory_ != &other.memory_;
+        }
+
+    private:
+        template <typename> friend class HandlerAllocator;
+
+        HandlerMemory &memory_;
+};
+
+// Completion handler wrapper that makes asio allocate its operation state from a HandlerMemory
+template <typename Handler>
+class CustomAllocHandler {
+    public:
+        typedef HandlerAllocator<Handler> allocator_type;
+
+        CustomAllocHandler(HandlerMemory &memory, Handler handler) 
+            : memory_(memory),
+              handler_(handler) {}
+
+        allocator_type get_allocator() const {
+            return allocator_type(memory_);
+        }
+
+        template <typename... Args>
+        void operator()(Args &&... args) {
+            handler_(std::forward<Args>(args)...);
+        }
+
+    private:
+        HandlerMemory &memory_;
+        Handler handler_;
+};
+
+template <typename Handler>
+inline CustomAllocHandler<Handler> MakeCustomAllocHandler(HandlerMemory &memory, Handler handler) {
+    return CustomAllocHandler<Handler>(memory, handler);
+}
+
+#endif
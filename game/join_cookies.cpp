@@ -0,0 +1,126 @@
+#include <random>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <stdexcept>
+
+#include "join_cookies.hpp"
+
+using namespace Protocol;
+
+namespace {
+
+// Cookies are valid for one to two windows
+const std::chrono::seconds kWindow(5);
+
+std::uint64_t Rotate(std::uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+void SipRound(std::uint64_t &v0, std::uint64_t &v1, std::uint64_t &v2, std::uint64_t &v3) {
+    v0 += v1; v1 = Rotate(v1, 13); v1 ^= v0; v0 = Rotate(v0, 32);
+    v2 += v3; v3 = Rotate(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = Rotate(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = Rotate(v1, 17); v1 ^= v2; v2 = Rotate(v2, 32);
+}
+
+// SipHash-2-4 of a message, little endian words as in the reference implementation
+std::uint64_t SipHash(const std::uint64_t key[2], const unsigned char *data, size_t size) {
+    std::uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL;
+    std::uint64_t v1 = key[1] ^ 0x646f72616e646f6dULL;
+    std::uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL;
+    std::uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+
+    // Whole words, then the tail padded with the message length in the top byte
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t m = 0;
+        for (int b = 0; b < 8; b++) {
+            m |= static_cast<std::uint64_t>(data[i + b]) << (8 * b);
+        }
+        v3 ^= m;
+        SipRound(v0, v1, v2, v3);
+        SipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    std::uint64_t m = static_cast<std::uint64_t>(size & 0xff) << 56;
+    for (int b = 0; i + b < size; b++) {
+        m |= static_cast<std::uint64_t>(data[i + b]) << (8 * b);
+    }
+    v3 ^= m;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= m;
+
+    // Finalize
+    v2 ^= 0xff;
+    for (int round = 0; round < 4; round++) {
+        SipRound(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+std::uint64_t Window(JoinCookies::Clock::time_point now) {
+    return now.time_since_epoch() / kWindow;
+}
+
+}
+
+JoinCookies::JoinCookies() {
+    std::random_device random;
+    for (int i = 0; i < 2; i++) {
+        key_[i] = (static_cast<std::uint64_t>(random()) << 32) | random();
+    }
+}
+
+JoinCookie JoinCookies::Issue(const boost::asio::ip::udp::endpoint &endpoint, int request, Clock::time_point now) const {
+    std::uint64_t mac = Mac(endpoint, request, Window(now));
+    JoinCookie cookie;
+    cookie.mac[0] = static_cast<unsigned int>(mac);
+    cookie.mac[1] = static_cast<unsigned int>(mac >> 32);
+    return cookie;
+}
+
+bool JoinCookies::Verify(const boost::asio::ip::udp::endpoint &endpoint, int request, const JoinCookie &cookie, Clock::time_point now) const {
+    std::uint64_t mac = static_cast<std::uint64_t>(cookie.mac[0]) | (static_cast<std::uint64_t>(cookie.mac[1]) << 32);
+    std::uint64_t window = Window(now);
+    return mac == Mac(endpoint, request, window) || mac == Mac(endpoint, request, window - 1);
+}
+
+std::uint64_t JoinCookies::Mac(const boost::asio::ip::udp::endpoint &endpoint, int request, std::uint64_t window) const {
+    // Address (v4 addresses mapped into v6), port, request kind and window
+    unsigned char message[16 + 2 + 4 + 8];
+    boost::asio::ip::address_v6::bytes_type address = endpoint.address().is_v4() ? 
+        boost::asio::ip::address_v6::v4_mapped(endpoint.address().to_v4()).to_bytes() : endpoint.address().to_v6().to_bytes();
+    memcpy(message, address.data(), 16);
+    unsigned short port = endpoint.port();
+    memcpy(message + 16, &port, 2);
+    memcpy(message + 18, &request, 4);
+    memcpy(message + 22, &window, 8);
+    return SipHash(key_, message, sizeof(message));
+}
+
+ReportKey::ReportKey(const std::string &hex) {
+    if (hex.size() != 32 || !std::all_of(hex.begin(), hex.end(), [](char c) { return isxdigit(static_cast<unsigned char>(c)); })) {
+        throw std::runtime_error("Report key must be 32 hex digits");
+    }
+    key_[0] = std::stoull(hex.substr(0, 16), nullptr, 16);
+    key_[1] = std::stoull(hex.substr(16), nullptr, 16);
+}
+
+void ReportKey::Sign(const char *report, ReportAuth &auth) const {
+    std::uint64_t mac = Mac(report);
+    auth.mac[0] = static_cast<unsigned int>(mac);
+    auth.mac[1] = static_cast<unsigned int>(mac >> 32);
+}
+
+bool ReportKey::Verify(const char *report, const ReportAuth &auth) const {
+    std::uint64_t mac = static_cast<std::uint64_t>(auth.mac[0]) | (static_cast<std::uint64_t>(auth.mac[1]) << 32);
+    return mac == Mac(report);
+}
+
+std::uint64_t ReportKey::Mac(const char *report) const {
+    // Header, load and cookie as laid out in the report
+    return SipHash(key_, reinterpret_cast<const unsigned char *>(report), 
+            sizeof(ClientDataHeader) + sizeof(ServerLoad) + sizeof(JoinCookie));
+}
@@ -0,0 +1,48 @@
+#ifndef JOIN_COOKIES_H
+#define JOIN_COOKIES_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <boost/asio.hpp>
+
+#include "protocol.hpp"
+
+// Stateless join handshake. A cookie is a keyed MAC (SipHash-2-4) over the requester's endpoint, the kind of request
+// and the current time window, so nothing is kept for a requester until it echoes a valid cookie from the same endpoint.
+class JoinCookies {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        // Keyed from the system's random source, cookies do not survive a restart
+        JoinCookies();
+
+        Protocol::JoinCookie Issue(const boost::asio::ip::udp::endpoint &endpoint, int request, Clock::time_point now) const;
+
+        // Accepts cookies from the current and previous window
+        bool Verify(const boost::asio::ip::udp::endpoint &endpoint, int request, const Protocol::JoinCookie &cookie, Clock::time_point now) const;
+
+    private:
+        std::uint64_t Mac(const boost::asio::ip::udp::endpoint &endpoint, int request, std::uint64_t window) const;
+
+        std::uint64_t key_[2];
+};
+
+// Key shared by game servers and their front door, so the front door only sends joins to servers that know it
+class ReportKey {
+    public:
+        // From 32 hex digits, throws std::runtime_error otherwise
+        explicit ReportKey(const std::string &hex);
+
+        // Fills in the MAC of a report, over everything before it
+        void Sign(const char *report, Protocol::ReportAuth &auth) const;
+
+        bool Verify(const char *report, const Protocol::ReportAuth &auth) const;
+
+    private:
+        std::uint64_t Mac(const char *report) const;
+
+        std::uint64_t key_[2];
+};
+
+#endif
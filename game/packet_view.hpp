@@ -0,0 +1,128 @@
+#ifndef PACKET_VIEW_H
+#define PACKET_VIEW_H
+
+#include <cstddef>
+
+#include "protocol.hpp"
+
+// Read-only view over a received client datagram, valid only while the underlying buffer is. Requests may carry a join cookie,
+// join requests an arena hash after it.
+// The buffer must be suitably aligned for the protocol structs.
+class ClientPacketView {
+    public:
+        ClientPacketView() 
+            : header_(nullptr),
+              data_(nullptr),
+              cookie_(nullptr),
+              arena_hash_(nullptr) {}
+
+        // Checks the length and protocol version, join requests carry no player data
+        bool Parse(const char *bytes, std::size_t size) {
+            if (size < sizeof(Protocol::ClientDataHeader)) {
+                return false;
+            }
+            header_ = reinterpret_cast<const Protocol::ClientDataHeader *>(bytes);
+            if (header_->version != Protocol::kVersion) {
+                return false;
+            }
+            if (header_->request) {
+                static const Protocol::TransmittedData no_data = Protocol::TransmittedData();
+                data_ = &no_data;
+                cookie_ = size >= sizeof(Protocol::ClientDataHeader) + sizeof(Protocol::JoinCookie) ? 
+                    reinterpret_cast<const Protocol::JoinCookie *>(bytes + sizeof(Protocol::ClientDataHeader)) : nullptr;
+                arena_hash_ = size >= sizeof(Protocol::ClientDataHeader) + sizeof(Protocol::JoinCookie) + sizeof(unsigned int) ? 
+                    reinterpret_cast<const unsigned int *>(bytes + sizeof(Protocol::ClientDataHeader) + sizeof(Protocol::JoinCookie)) : nullptr;
+                return true;
+            }
+            cookie_ = nullptr;
+            arena_hash_ = nullptr;
+            if (size < sizeof(Protocol::ClientDataHeader) + sizeof(Protocol::TransmittedData)) {
+                return false;
+            }
+            data_ = reinterpret_cast<const Protocol::TransmittedData *>(bytes + sizeof(Protocol::ClientDataHeader));
+            return true;
+        }
+
+        const Protocol::ClientDataHeader &Header() const {
+            return *header_;
+        }
+
+        const Protocol::TransmittedData &Data() const {
+            return *data_;
+        }
+
+        // Cookie echoed after a request, null if there is none
+        const Protocol::JoinCookie *Cookie() const {
+            return cookie_;
+        }
+
+        // Client's arena hash after the cookie, null if there is none
+        const unsigned int *ArenaHash() const {
+            return arena_hash_;
+        }
+
+    private:
+        const Protocol::ClientDataHeader *header_;
+        const Protocol::TransmittedData *data_;
+        const Protocol::JoinCookie *cookie_;
+        const unsigned int *arena_hash_;
+};
+
+// Read-only view over a received server datagram, events and player states are read in place without copying.
+// Same lifetime and alignment requirements as ClientPacketView.
+class ServerPacketView {
+    public:
+        ServerPacketView() 
+            : header_(nullptr),
+              events_(nullptr),
+              players_(nullptr) {}
+
+        // Checks the protocol version and that the datagram holds everything the header says it holds
+        bool Parse(const char *bytes, std::size_t size) {
+            if (size < sizeof(Protocol::ServerDataHeader)) {
+                return false;
+            }
+            header_ = reinterpret_cast<const Protocol::ServerDataHeader *>(bytes);
+            if (header_->version != Protocol::kVersion || header_->num_events > Protocol::kMaxEventsPerPacket) {
+                return false;
+            }
+            std::size_t events_bytes = header_->num_events * sizeof(Protocol::GameEvent);
+            if (size < sizeof(Protocol::ServerDataHeader) + events_bytes) {
+                return false;
+            }
+            // Divide rather than multiply so a bogus player count cannot overflow
+            if ((size - sizeof(Protocol::ServerDataHeader) - events_bytes) / sizeof(Protocol::TransmittedData) < header_->num_players) {
+                return false;
+            }
+            events_ = reinterpret_cast<const Protocol::GameEvent *>(bytes + sizeof(Protocol::ServerDataHeader));
+            players_ = reinterpret_cast<const Protocol::TransmittedData *>(bytes + sizeof(Protocol::ServerDataHeader) + events_bytes);
+            return true;
+        }
+
+        const Protocol::ServerDataHeader &Header() const {
+            return *header_;
+        }
+
+        const Protocol::GameEvent *EventsBegin() const {
+            return events_;
+        }
+
+        const Protocol::GameEvent *EventsEnd() const {
+            return events_ + header_->num_events;
+        }
+
+        const Protocol::TransmittedData *PlayersBegin() const {
+            return players_;
+        }
+
+        const Protocol::TransmittedData *PlayersEnd() const {
+            return players_ + header_->num_players;
+        }
+
+    private:
+        const Protocol::ServerDataHeader *header_;
+        const Protocol::GameEvent *events_;
+        const Protocol::TransmittedData *players_;
+};
+
+#endif
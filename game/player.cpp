@@ -6,6 +6,8 @@
 using namespace Protocol;
 using namespace Geometry;
 
+const float Player::kRadius = 5;
+
 Player::Player(const TransmittedData &data) 
     : player_num_(data.player_num),
       position_(data.x_pos, data.y_pos),
@@ -14,7 +16,7 @@ Player::Player(const TransmittedData &data)
       laser_(data.laser) {}
 
 
-TransmittedData Player::Data() {
+TransmittedData Player::Data() const {
     TransmittedData data;
     data.player_num = player_num_;
     data.x_pos = position_.x;
@@ -8,7 +8,7 @@ class Player {
     public:
         Player(const Protocol::TransmittedData &data); 
 
-        Protocol::TransmittedData Data();
+        Protocol::TransmittedData Data() const;
 
         void Update(const Protocol::TransmittedData &data);
 
@@ -38,6 +38,9 @@ class Player {
 
         bool Laser() const;
 
+        // Size of the player for collisions with the arena
+        static const float kRadius;
+
     private:
         int player_num_;
         Protocol::Team team_;
@@ -0,0 +1,40 @@
+#include "player_table.hpp"
+
+using namespace Protocol;
+
+PlayerTable::PlayerTable(unsigned int max_age) 
+    : max_age_(max_age) {}
+
+void PlayerTable::Update(const TransmittedData &data, unsigned int generation) {
+    if (data.player_num >= kMaxPlayerNum) {
+        return;
+    }
+
+    // Grow the table on first sight of a number, it only ever holds as many entries as concurrent players
+    if (data.player_num >= slots_.size()) {
+        slots_.resize(data.player_num + 1, Slot());
+    }
+    Slot &slot = slots_[data.player_num];
+    slot.active = true;
+    slot.generation = generation;
+    slot.data = data;
+}
+
+void PlayerTable::Remove(unsigned int player_num) {
+    // The number may be reused for a later player, who activates the entry again
+    if (player_num < slots_.size()) {
+        slots_[player_num].active = false;
+    }
+}
+
+bool PlayerTable::Active(unsigned int player_num) const {
+    return player_num < slots_.size() && slots_[player_num].active;
+}
+
+const TransmittedData &PlayerTable::Data(unsigned int player_num) const {
+    return slots_[player_num].data;
+}
+
+size_t PlayerTable::Size() const {
+    return slots_.size();
+}
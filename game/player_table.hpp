@@ -0,0 +1,54 @@
+#ifndef PLAYER_TABLE_H
+#define PLAYER_TABLE_H
+
+#include <vector>
+#include <cstddef>
+
+#include "protocol.hpp"
+
+// Latest known state of every player, indexed by player number. Each entry is stamped with the generation (the
+// sender's sequence number) it was last written in, so players whose state stopped arriving are dropped while walking
+// the table rather than needing a separate sweep.
+class PlayerTable {
+    public:
+        PlayerTable(unsigned int max_age);
+
+        void Update(const Protocol::TransmittedData &data, unsigned int generation);
+
+        void Remove(unsigned int player_num);
+
+        bool Active(unsigned int player_num) const;
+
+        const Protocol::TransmittedData &Data(unsigned int player_num) const;
+
+        // Number of entries, active or not, player numbers are below this
+        size_t Size() const;
+
+        // Calls function with every active player, dropping those not written within max_age generations of the given one
+        template <typename Function>
+        void ForEachActive(unsigned int generation, Function function) {
+            for (Slot &slot : slots_) {
+                if (slot.active && generation - slot.generation > max_age_) {
+                    slot.active = false;
+                }
+                if (slot.active) {
+                    function(slot.data);
+                }
+            }
+        }
+
+        // Player numbers are reused by the server, anything beyond this is a corrupt packet rather than a real player
+        static const unsigned int kMaxPlayerNum = 1 << 16;
+
+    private:
+        struct Slot {
+            bool active;
+            unsigned int generation;
+            Protocol::TransmittedData data;
+        };
+
+        unsigned int max_age_;
+        std::vector<Slot> slots_;
+};
+
+#endif
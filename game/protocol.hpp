@@ -3,19 +3,95 @@
 
 namespace Protocol {
 
+// Bumped whenever the wire format changes, packets from other versions are dropped
+const unsigned int kVersion = 5;
+
+// Largest datagram either side sends, keeps packets within a typical Ethernet MTU
+const unsigned int kMaxDatagramSize = 1472;
+
+// Sequence numbers start at 1, an ack of 0 means nothing has been received yet. Times are milliseconds on the sender's
+// own steady clock, each side echoes the other's latest time so both can measure the round trip (see ClockSync).
 struct ServerDataHeader {
+    unsigned int version;
     unsigned int client_player_num;
-    unsigned int num_players;
-    unsigned int red_score;
-    unsigned int blue_score;
+    unsigned int num_events;  // Reliable events following the header
+    unsigned int num_players; // Player states following the events
     unsigned int server_seq_num;
+    unsigned int ack;         // Latest client sequence number received
+    unsigned int ack_bits;    // Bit i set if client sequence number ack - 1 - i was received
+    unsigned int server_tick; // Tick the packet was produced in
+    unsigned int send_time;   // Start of that tick
+    unsigned int echo_time;   // send_time of the latest client packet received
+    unsigned int echo_delay;  // Milliseconds between receiving that packet and send_time, ClockSync::kNoEcho if none
+    unsigned int spawn_count; // Times the receiving player has spawned, its own state in the packet is the spawn when this changes
 };
 
+typedef enum {
+    no_request = 0,       // Player data follows the header
+    join_request = 1,     // Enter the game as a player
+    spectate_request = 2, // Receive the game's packets without playing
+    spectator_ack = 3,    // Keeps a spectator subscribed and acks what it received, nothing follows the header
+    locate_request = 4,   // Asks a front door which server to join, answered with a Redirect
+    server_report = 5     // Game server's load report to a front door, a ServerLoad and ReportAuth follow the header
+} Request;
+
 struct ClientDataHeader {
-    int request;
+    unsigned int version;
+    int request;              // One of Request
     unsigned int seq_num;
+    unsigned int ack;         // Latest server sequence number received
+    unsigned int ack_bits;    // Bit i set if server sequence number ack - 1 - i was received
+    unsigned int send_time;
+    unsigned int echo_time;   // send_time of the latest server packet received
+    unsigned int echo_delay;  // Milliseconds between receiving that packet and send_time, ClockSync::kNoEcho if none
 };
 
+// Load of a game server as reported to the front door, which redirects joins to the sender of the report
+struct ServerLoad {
+    unsigned int num_players;
+    unsigned int num_spectators;
+    float tick_load;          // Fraction of the tick interval spent working
+};
+
+// Front door's answer to a locate request
+struct Redirect {
+    unsigned int version;
+    unsigned int address;     // IPv4 address in host byte order
+    unsigned int port;
+};
+
+// Value of client_player_num in packets sent to spectators
+const unsigned int kSpectatorPlayerNum = 0xFFFFFFFF;
+
+// Value of client_player_num marking a JoinChallenge rather than game data
+const unsigned int kChallengePlayerNum = 0xFFFFFFFE;
+
+// Proof that a join or spectate request came from the endpoint it claims, echoed after the request header. A join
+// request follows it with the hash of the client's arena, joins with another map than the server's are refused.
+struct JoinCookie {
+    unsigned int mac[2];
+};
+
+// Server's stateless answer to a join or spectate request without a valid cookie, also the front door's answer to a
+// report without one
+struct JoinChallenge {
+    unsigned int version;
+    unsigned int client_player_num; // kChallengePlayerNum
+    JoinCookie cookie;
+    unsigned int arena_hash;        // Arena::Hash of the game's map, clients with another map do not join
+};
+
+// Ends a load report. The cookie is the one the front door last challenged the server with, proving the report comes
+// from the endpoint joins will be sent to, and the MAC covers the header, load and cookie under the key the servers
+// share with the front door.
+struct ReportAuth {
+    JoinCookie cookie;
+    unsigned int mac[2];
+};
+
+// Largest number of reliable events carried in a single packet
+const unsigned int kMaxEventsPerPacket = 8;
+
 typedef enum {
     red = 0,
     blue = 1
@@ -30,6 +106,28 @@ struct TransmittedData {
     float dir_y;
     int laser;
 };
+
+typedef enum {
+    player_joined = 0,  // Player entered the game
+    player_left = 1,    // Player's session ended
+    player_hit = 2,     // Player was hit by other_num's laser, hits are always lethal so the player respawns
+    score_changed = 3   // Team scores changed
+} EventType;
+
+// Discrete game event, delivered reliably and in order by event_id
+struct GameEvent {
+    unsigned int event_id;
+    EventType type;
+    unsigned int player_num;
+    unsigned int other_num;
+    Team team;
+    float x_pos;
+    float y_pos;
+    float dir_x;
+    float dir_y;
+    unsigned int red_score;
+    unsigned int blue_score;
+};
             
 }
 
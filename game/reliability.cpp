@@ -0,0 +1,254 @@
+#include <algorithm>
+
+#include "reliability.hpp"
+
+using namespace Protocol;
+
+namespace Reliability {
+
+namespace {
+
+// Events only the latest of which matters per player, scores are all about player 0
+bool LatestWins(const GameEvent &event) {
+    return event.type == score_changed || event.type == player_hit;
+}
+
+// Events the peer can do without, the players involved show up in snapshots
+bool Droppable(const GameEvent &event) {
+    return event.type == player_joined || event.type == player_hit;
+}
+
+// Acks ride on the peer's own packets, which may be this far apart at the lowest send rate
+const std::chrono::milliseconds kMaxAckHold(100);
+
+}
+
+AckTracker::AckTracker() 
+    : ack_(0),
+      ack_bits_(0) {}
+
+AckTracker::AckTracker(unsigned int ack, unsigned int ack_bits) 
+    : ack_(ack),
+      ack_bits_(ack_bits) {}
+
+void AckTracker::OnReceived(unsigned int seq_num) {
+    if (seq_num > ack_) {
+        // Newer than anything seen, shift the history along and remember the old latest
+        unsigned int shift = seq_num - ack_;
+        if (shift > 32) {
+            ack_bits_ = 0;
+        } else {
+            ack_bits_ = shift == 32 ? 0 : ack_bits_ << shift;
+            if (ack_ != 0) {
+                ack_bits_ |= 1u << (shift - 1);
+            }
+        }
+        ack_ = seq_num;
+    } else if (seq_num < ack_ && ack_ - seq_num <= 32) {
+        // Late packet still within the bitfield
+        ack_bits_ |= 1u << (ack_ - seq_num - 1);
+    }
+}
+
+unsigned int AckTracker::Ack() const {
+    return ack_;
+}
+
+unsigned int AckTracker::AckBits() const {
+    return ack_bits_;
+}
+
+EventSender::EventSender() 
+    : next_event_id_(0),
+      head_(0) {
+    for (unsigned int i = 0; i < kSentHistory; i++) {
+        sent_[i].seq_num = 0;
+        sent_[i].first_id = 0;
+        sent_[i].id_mask = 0;
+    }
+}
+
+void EventSender::Push(const GameEvent &event) {
+    // A peer that is behind gets no more joins and hits, this is the common case in a busy room so it is checked first
+    if (Pending() >= kMaxPending && Droppable(event)) {
+        return;
+    }
+
+    // Write sends in order, so the events that have not gone out yet are the tail of the queue and can still change
+    if (LatestWins(event)) {
+        for (size_t i = queue_.size(); i > head_ && !queue_[i - 1].sent; i--) {
+            GameEvent &queued = queue_[i - 1].event;
+            if (queued.type == event.type && queued.player_num == event.player_num) {
+                unsigned int event_id = queued.event_id;
+                queued = event;
+                queued.event_id = event_id;
+                return;
+            }
+        }
+    }
+    if (Pending() >= kMaxPending && !MakeRoom()) {
+        return;
+    }
+
+    PendingEvent pending;
+    pending.event = event;
+    pending.event.event_id = next_event_id_++;
+    pending.acked = false;
+    pending.sent = false;
+    queue_.push_back(pending);
+}
+
+void EventSender::Write(unsigned int seq_num, Clock::time_point now, Clock::duration resend_after, std::vector<GameEvent> &events) {
+    // Remember which events went out in this packet so its ack can release them
+    SentPacket &packet = sent_[seq_num % kSentHistory];
+    packet.seq_num = seq_num;
+    packet.id_mask = 0;
+
+    // Oldest unacked events first, skipping ones that are still in flight. Events too far past the first one wait
+    // for a later packet, there are only that many when a burst is still in flight.
+    unsigned int num_events = 0;
+    for (size_t i = head_; i < queue_.size() && num_events < kMaxEventsPerPacket; i++) {
+        PendingEvent &pending = queue_[i];
+        if (pending.acked || (pending.sent && now - pending.last_sent < resend_after)) {
+            continue;
+        }
+        if (num_events == 0) {
+            packet.first_id = pending.event.event_id;
+        } else if (pending.event.event_id - packet.first_id >= kIdSpan) {
+            break;
+        }
+        pending.sent = true;
+        pending.last_sent = now;
+        events.push_back(pending.event);
+        packet.id_mask |= 1u << (pending.event.event_id - packet.first_id);
+        num_events++;
+    }
+}
+
+Clock::duration EventSender::ResendAfter(float rtt) {
+    std::chrono::duration<float> round_trip(std::max(1.5f * rtt, 0.05f));
+    return std::chrono::duration_cast<Clock::duration>(round_trip) + kMaxAckHold;
+}
+
+void EventSender::OnAcks(unsigned int ack, unsigned int ack_bits) {
+    if (ack == 0) {
+        // Peer has not received anything yet
+        return;
+    }
+
+    Acknowledge(ack);
+    for (unsigned int i = 0; i < 32 && i + 1 < ack; i++) {
+        if (ack_bits & (1u << i)) {
+            Acknowledge(ack - 1 - i);
+        }
+    }
+
+    // Drop the events the peer has for sure, moving the rest down once the dropped ones are the larger part
+    while (head_ < queue_.size() && queue_[head_].acked) {
+        head_++;
+    }
+    if (head_ == queue_.size()) {
+        queue_.clear();
+        head_ = 0;
+    } else if (head_ > queue_.size() / 2) {
+        queue_.erase(queue_.begin(), queue_.begin() + head_);
+        head_ = 0;
+    }
+}
+
+bool EventSender::MakeRoom() {
+    // Drop the oldest unsent join or hit, renumbering the unsent events after it as the peer has seen none of them
+    size_t unsent = queue_.size();
+    while (unsent > head_ && !queue_[unsent - 1].sent) {
+        unsent--;
+    }
+    for (size_t i = unsent; i < queue_.size(); i++) {
+        if (Droppable(queue_[i].event)) {
+            for (size_t j = i + 1; j < queue_.size(); j++) {
+                queue_[j].event.event_id--;
+            }
+            queue_.erase(queue_.begin() + i);
+            next_event_id_--;
+            return true;
+        }
+    }
+
+    // Everything waiting matters more, or is in flight
+    return false;
+}
+
+size_t EventSender::Pending() const {
+    return queue_.size() - head_;
+}
+
+size_t EventSender::MemoryUsage() const {
+    return queue_.capacity() * sizeof(PendingEvent);
+}
+
+void EventSender::Save(unsigned int &next_event_id, std::vector<GameEvent> &pending) const {
+    // Everything from the first unacked event on, keeping ids consecutive, the peer drops any it already has
+    next_event_id = next_event_id_;
+    pending.clear();
+    for (size_t i = head_; i < queue_.size(); i++) {
+        pending.push_back(queue_[i].event);
+    }
+}
+
+void EventSender::Restore(unsigned int next_event_id, const std::vector<GameEvent> &pending) {
+    next_event_id_ = next_event_id;
+    queue_.clear();
+    head_ = 0;
+    for (const GameEvent &event : pending) {
+        PendingEvent restored;
+        restored.event = event;
+        restored.acked = false;
+        restored.sent = false;
+        queue_.push_back(restored);
+    }
+}
+
+void EventSender::Acknowledge(unsigned int seq_num) {
+    SentPacket &packet = sent_[seq_num % kSentHistory];
+    if (packet.seq_num != seq_num || head_ == queue_.size()) {
+        return;
+    }
+
+    // Queue holds consecutive event ids, so the id gives the position
+    unsigned int first_id = queue_[head_].event.event_id;
+    for (unsigned int bit = 0; bit < kIdSpan; bit++) {
+        if (!(packet.id_mask & (1u << bit))) {
+            continue;
+        }
+        unsigned int id = packet.first_id + bit;
+        unsigned int index = id - first_id;
+        if (id >= first_id && index < Pending()) {
+            queue_[head_ + index].acked = true;
+        }
+    }
+    packet.id_mask = 0;
+}
+
+EventReceiver::EventReceiver() 
+    : next_event_id_(0) {}
+
+void EventReceiver::OnReceived(const GameEvent &event) {
+    // Ignore duplicates of events already delivered, and ids further ahead than a sender keeps pending so a bad peer
+    // cannot grow the queue without bound
+    if (event.event_id - next_event_id_ < EventSender::kMaxPending) {
+        early_[event.event_id] = event;
+    }
+}
+
+bool EventReceiver::Next(GameEvent &event) {
+    auto iter = early_.find(next_event_id_);
+    if (iter == early_.end()) {
+        return false;
+    }
+
+    event = iter->second;
+    early_.erase(iter);
+    next_event_id_++;
+    return true;
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef RELIABILITY_H
+#define RELIABILITY_H
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "protocol.hpp"
+
+namespace Reliability {
+
+typedef std::chrono::steady_clock Clock;
+
+// Tracks which peer sequence numbers arrived, producing the ack and ack bitfield for outgoing headers
+class AckTracker {
+    public:
+        AckTracker();
+
+        AckTracker(unsigned int ack, unsigned int ack_bits);
+
+        void OnReceived(unsigned int seq_num);
+
+        unsigned int Ack() const;
+
+        unsigned int AckBits() const;
+
+    private:
+        unsigned int ack_;
+        unsigned int ack_bits_;
+};
+
+// Queue of events resent in outgoing packets until the peer acks a packet that carried them
+class EventSender {
+    public:
+        // Most events waiting for a peer. A peer this far behind gets no new joins and hits, as it learns of those
+        // players from snapshots anyway, and other events take the place of unsent joins and hits or are dropped too.
+        static const size_t kMaxPending = 64;
+
+        EventSender();
+
+        // Scores and hits are latest wins, they replace a queued one about the same player that has not gone out yet
+        void Push(const Protocol::GameEvent &event);
+
+        void Write(unsigned int seq_num, Clock::time_point now, Clock::duration resend_after, std::vector<Protocol::GameEvent> &events);
+
+        // How long to wait for a packet's ack before resending its events, given the link's RTT in seconds
+        static Clock::duration ResendAfter(float rtt);
+
+        void OnAcks(unsigned int ack, unsigned int ack_bits);
+
+        size_t Pending() const;
+
+        // Bytes held including the queue's storage
+        size_t MemoryUsage() const;
+
+        // Events not yet released and the next event id, for carrying the channel over to another process
+        void Save(unsigned int &next_event_id, std::vector<Protocol::GameEvent> &pending) const;
+
+        // Continues a saved channel, the restored events go out again as if never sent
+        void Restore(unsigned int next_event_id, const std::vector<Protocol::GameEvent> &pending);
+
+    private:
+        void Acknowledge(unsigned int seq_num);
+
+        bool MakeRoom();
+
+        // As far back as the send scheduler looks, an ack older than this only costs a resend
+        static const unsigned int kSentHistory = 64;
+
+        // Events in a packet lie within this many ids of its first one
+        static const unsigned int kIdSpan = 32;
+
+        struct PendingEvent {
+            Protocol::GameEvent event;
+            bool acked;
+            bool sent;
+            Clock::time_point last_sent;
+        };
+
+        // Events carried by a packet as a bitmask of ids from first_id
+        struct SentPacket {
+            unsigned int seq_num;
+            unsigned int first_id;
+            unsigned int id_mask;
+        };
+
+        unsigned int next_event_id_;
+
+        // Pending events are queue_[head_] onwards, the acked ones before head_ are dropped in batches
+        std::vector<PendingEvent> queue_;
+        size_t head_;
+        SentPacket sent_[kSentHistory];
+};
+
+// Delivers events in event_id order exactly once, holding back events that arrive early
+class EventReceiver {
+    public:
+        EventReceiver();
+
+        void OnReceived(const Protocol::GameEvent &event);
+
+        bool Next(Protocol::GameEvent &event);
+
+    private:
+        unsigned int next_event_id_;
+        std::map<unsigned int, Protocol::GameEvent> early_;
+};
+
+}
+
+#endif
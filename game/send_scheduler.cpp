@@ -0,0 +1,166 @@
+#include <algorithm>
+
+#include "send_scheduler.hpp"
+
+namespace {
+
+// How often the rate is re-evaluated
+const std::chrono::milliseconds kAdaptInterval(1000);
+
+// Span of each of the two windows the minimum RTT is taken over
+const std::chrono::seconds kMinRttWindow(10);
+
+// Link is considered congested past these thresholds
+const float kBackoffLoss = 0.05;
+const float kBackoffRttMargin = 0.05;
+
+// Headroom required before ramping the rate back up
+const float kRampLoss = 0.01;
+const float kRampLoad = 0.5;
+const float kBackoffLoad = 0.8;
+
+const float kBackoffFactor = 0.75;
+const float kRampStepHz = 5.0;
+
+}
+
+SendScheduler::SendScheduler(float min_rate_hz, float max_rate_hz, unsigned int bytes_per_second) 
+    : min_rate_hz_(min_rate_hz),
+      max_rate_hz_(max_rate_hz),
+      rate_hz_(max_rate_hz),
+      bytes_per_second_(bytes_per_second),
+      tokens_(bytes_per_second / max_rate_hz),
+      last_refill_(Clock::now()),
+      next_send_(Clock::now()),
+      next_adapt_(Clock::now() + kAdaptInterval),
+      rtt_(0.0),
+      min_rtt_(0.0),
+      loss_(0.0),
+      load_(0.0),
+      window_min_rtt_(-1.0),
+      last_window_min_rtt_(-1.0),
+      next_min_rtt_window_(Clock::now() + kMinRttWindow),
+      have_peer_seq_(false),
+      window_first_seq_(0),
+      window_last_seq_(0),
+      window_received_(0),
+      window_sent_(0),
+      window_acked_(0),
+      acked_(~uint64_t(0)) {
+    for (int i = 0; i < kHistorySize; i++) {
+        sent_[i] = 0;
+    }
+}
+
+bool SendScheduler::ShouldSend(Clock::time_point now, size_t packet_bytes) {
+    // Re-evaluate the rate periodically
+    if (now >= next_adapt_) {
+        Adapt(now);
+    }
+
+    // Refill the bucket, allowing a burst of up to a tenth of a second of budget
+    float elapsed = std::chrono::duration<float>(now - last_refill_).count();
+    last_refill_ = now;
+    tokens_ = std::min(tokens_ + elapsed * bytes_per_second_, std::max(bytes_per_second_ / 10, float(packet_bytes)));
+
+    // Allow a millisecond of slack so timer wakeups landing just before the deadline still send
+    if (now + std::chrono::milliseconds(1) < next_send_) {
+        return false;
+    }
+    return tokens_ >= packet_bytes;
+}
+
+void SendScheduler::OnSent(unsigned int seq_num, Clock::time_point now, size_t packet_bytes) {
+    // Spend the budget and schedule the next send at the current rate
+    tokens_ -= packet_bytes;
+    next_send_ = std::max(next_send_ + Interval(), now);
+    window_sent_++;
+
+    // Remember it so its ack counts as feedback once
+    sent_[seq_num % kHistorySize] = seq_num;
+    acked_ &= ~(uint64_t(1) << (seq_num % kHistorySize));
+}
+
+void SendScheduler::OnAck(unsigned int ack_seq_num) {
+    // Only the first ack of a packet we still remember counts. Acks are not timed, they wait for the peer's next send.
+    uint64_t acked_bit = uint64_t(1) << (ack_seq_num % kHistorySize);
+    if ((acked_ & acked_bit) || sent_[ack_seq_num % kHistorySize] != ack_seq_num) {
+        return;
+    }
+    acked_ |= acked_bit;
+    window_acked_++;
+}
+
+void SendScheduler::OnRttSample(float sample, float rtt, Clock::time_point now) {
+    // Start a new minimum window now and then, keeping the last one so the minimum never rests on a handful of samples
+    if (now >= next_min_rtt_window_) {
+        next_min_rtt_window_ = now + kMinRttWindow;
+        last_window_min_rtt_ = window_min_rtt_;
+        window_min_rtt_ = -1.0;
+    }
+    if (window_min_rtt_ < 0 || sample < window_min_rtt_) {
+        window_min_rtt_ = sample;
+    }
+    min_rtt_ = last_window_min_rtt_ < 0 ? window_min_rtt_ : std::min(window_min_rtt_, last_window_min_rtt_);
+    rtt_ = rtt;
+}
+
+void SendScheduler::OnReceived(unsigned int peer_seq_num) {
+    // Count packets from the peer so gaps in its sequence numbers show up as loss
+    if (!have_peer_seq_) {
+        have_peer_seq_ = true;
+        window_first_seq_ = window_last_seq_ = peer_seq_num;
+    }
+    if (peer_seq_num < window_first_seq_) {
+        // Late packet from the previous window
+        return;
+    }
+    window_last_seq_ = std::max(window_last_seq_, peer_seq_num);
+    window_received_++;
+}
+
+void SendScheduler::SetLoad(float load) {
+    load_ = load;
+}
+
+std::chrono::microseconds SendScheduler::Interval() const {
+    return std::chrono::microseconds(static_cast<long>(1000000 / rate_hz_));
+}
+
+float SendScheduler::Rate() const {
+    return rate_hz_;
+}
+
+float SendScheduler::Loss() const {
+    return loss_;
+}
+
+float SendScheduler::Rtt() const {
+    return rtt_;
+}
+
+void SendScheduler::Adapt(Clock::time_point now) {
+    next_adapt_ = now + kAdaptInterval;
+
+    // Whether the peer showed any sign of getting what we sent, the estimates below are stale otherwise
+    bool sent = window_sent_ > 0;
+    bool heard = window_received_ > 0 || window_acked_ > 0;
+    window_sent_ = window_acked_ = 0;
+
+    // Loss over the window that just ended
+    if (have_peer_seq_ && window_received_ > 0) {
+        float expected = window_last_seq_ - window_first_seq_ + 1;
+        float window_loss = std::max(0.0f, 1 - window_received_ / expected);
+        loss_ = 0.5 * loss_ + 0.5 * window_loss;
+        window_first_seq_ = window_last_seq_ + 1;
+        window_received_ = 0;
+    }
+
+    // Back off multiplicatively when congested or when sends go unanswered, ramp up additively when there is headroom
+    bool rtt_rising = rtt_ > min_rtt_ * 1.5 + kBackoffRttMargin;
+    if (loss_ > kBackoffLoss || rtt_rising || load_ > kBackoffLoad || (sent && !heard)) {
+        rate_hz_ = std::max(min_rate_hz_, rate_hz_ * kBackoffFactor);
+    } else if (sent && loss_ < kRampLoss && load_ < kRampLoad) {
+        rate_hz_ = std::min(max_rate_hz_, rate_hz_ + kRampStepHz);
+    }
+}
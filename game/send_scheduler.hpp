@@ -0,0 +1,64 @@
+#ifndef SEND_SCHEDULER_H
+#define SEND_SCHEDULER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Decides when to send to one peer. The send rate moves between a minimum and maximum, backing off when the link
+// (loss, RTT) or the local tick load gets worse and ramping up again when there is headroom. Headroom has to be shown
+// by the peer: a window in which packets went out but nothing came back backs off, and one with nothing sent holds the
+// rate. A token bucket keeps the bytes sent within a per-peer bandwidth budget.
+class SendScheduler {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        SendScheduler(float min_rate_hz, float max_rate_hz, unsigned int bytes_per_second);
+
+        bool ShouldSend(Clock::time_point now, size_t packet_bytes);
+
+        void OnSent(unsigned int seq_num, Clock::time_point now, size_t packet_bytes);
+
+        void OnAck(unsigned int ack_seq_num);
+
+        // Round trip sample and smoothed RTT in seconds from the link's echoed timestamps (ClockSync::LinkTimer), which 
+        // leave out how long the peer held our packet before answering
+        void OnRttSample(float sample, float rtt, Clock::time_point now);
+
+        void OnReceived(unsigned int peer_seq_num);
+
+        void SetLoad(float load);
+
+        std::chrono::microseconds Interval() const;
+
+        float Rate() const;
+
+        float Loss() const;
+
+        float Rtt() const;
+
+    private:
+        void Adapt(Clock::time_point now);
+
+        static const int kHistorySize = 64;
+
+        float min_rate_hz_, max_rate_hz_, rate_hz_;
+        float bytes_per_second_, tokens_;
+        Clock::time_point last_refill_, next_send_, next_adapt_;
+
+        // Link quality estimates. The minimum RTT is the lower of this window's and the last one's, so it follows route changes.
+        float rtt_, min_rtt_, loss_, load_;
+        float window_min_rtt_, last_window_min_rtt_;  // Negative while a window has no samples
+        Clock::time_point next_min_rtt_window_;
+
+        // Peer sequence numbers seen, and our packets sent and acked, in the current adaptation window
+        bool have_peer_seq_;
+        unsigned int window_first_seq_, window_last_seq_, window_received_;
+        unsigned int window_sent_, window_acked_;
+
+        // Sent sequence numbers modulo the history size, bit i of acked_ set once slot i was acked
+        uint64_t acked_;
+        unsigned int sent_[kHistorySize];
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <unistd.h>
+
+#include "trace.hpp"
+
+namespace Trace {
+
+std::atomic<bool> enabled(false);
+
+namespace {
+
+struct Event {
+    const char *name;
+    const char *arg_name;
+    long long arg_value;
+    long long start_us;
+    long long duration_us;
+};
+
+// Written only by its own thread, the head is published so a writer on another thread sees complete events
+struct ThreadBuffer {
+    ThreadBuffer(size_t capacity, int thread_id) 
+        : events(capacity),
+          head(0),
+          thread_id(thread_id) {}
+
+    std::vector<Event> events;
+    std::atomic<unsigned long long> head;
+    int thread_id;
+};
+
+// Buffers outlive their threads so exited threads still show up in the trace
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+std::string trace_process_name;
+size_t capacity = 0;
+
+thread_local ThreadBuffer *local_buffer = nullptr;
+
+ThreadBuffer *LocalBuffer() {
+    if (!local_buffer) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer(capacity, registry.size())));
+        local_buffer = registry.back().get();
+    }
+    return local_buffer;
+}
+
+long long Microseconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+}
+
+void Enable(const std::string &process_name, size_t events_per_thread) {
+    if (Enabled()) {
+        return;
+    }
+    trace_process_name = process_name;
+    capacity = std::max(events_per_thread, size_t(1));
+    enabled.store(true, std::memory_order_release);
+}
+
+void Span::Record(const char *name, const char *arg_name, long long arg_value, 
+        std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    ThreadBuffer *buffer = LocalBuffer();
+    unsigned long long head = buffer->head.load(std::memory_order_relaxed);
+    Event &event = buffer->events[head % buffer->events.size()];
+    event.name = name;
+    event.arg_name = arg_name;
+    event.arg_value = arg_value;
+    event.start_us = Microseconds(start);
+    event.duration_us = Microseconds(end) - event.start_us;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool Write(const std::string &path) {
+    std::ofstream file(path.c_str());
+    if (!file) {
+        return false;
+    }
+
+    // Name the process, then every complete span of every thread, oldest first
+    int pid = getpid();
+    file << "{\"traceEvents\":[" << std::endl;
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":0,\"args\":{\"name\":\"" << trace_process_name << "\"}}";
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const std::unique_ptr<ThreadBuffer> &buffer : registry) {
+        unsigned long long head = buffer->head.load(std::memory_order_acquire);
+        unsigned long long size = buffer->events.size();
+        for (unsigned long long i = head > size ? head - size : 0; i < head; i++) {
+            const Event &event = buffer->events[i % size];
+            file << "," << std::endl << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us 
+                << ",\"pid\":" << pid << ",\"tid\":" << buffer->thread_id;
+            if (event.arg_name) {
+                file << ",\"args\":{\"" << event.arg_name << "\":" << event.arg_value << "}";
+            }
+            file << "}";
+        }
+    }
+    file << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+    return static_cast<bool>(file);
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstddef>
+
+// Opt-in timeline tracing. Spans go into a fixed ring buffer per thread without locking and are written out on demand
+// in the Chrome trace-event JSON format (chrome://tracing or ui.perfetto.dev). Timestamps come from the steady clock,
+// which all processes on a machine share, so server and client traces taken on one machine line up.
+namespace Trace {
+
+extern std::atomic<bool> enabled;
+
+// Starts recording, keeping the latest events_per_thread spans of every thread
+void Enable(const std::string &process_name, size_t events_per_thread = 1 << 16);
+
+inline bool Enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+// Writes everything recorded so far, spans being overwritten while writing may come out torn
+bool Write(const std::string &path);
+
+// Records the time from construction to destruction, with an optional integer argument such as a sequence number
+class Span {
+    public:
+        explicit Span(const char *name) 
+            : name_(name),
+              arg_name_(nullptr),
+              arg_value_(0),
+              active_(Enabled()) {
+            if (active_) {
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~Span() {
+            if (active_) {
+                Record(name_, arg_name_, arg_value_, start_, std::chrono::steady_clock::now());
+            }
+        }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+        void SetArg(const char *arg_name, long long arg_value) {
+            arg_name_ = arg_name;
+            arg_value_ = arg_value;
+        }
+
+    private:
+        static void Record(const char *name, const char *arg_name, long long arg_value, 
+                std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+        const char *name_;
+        const char *arg_name_;
+        long long arg_value_;
+        bool active_;
+        std::chrono::steady_clock::time_point start_;
+};
+
+}
+
+// Span covering the rest of the enclosing scope
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) Trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef XOSHIRO_H
+#define XOSHIRO_H
+
+#include <cstdint>
+#include <random>
+
+// xoshiro256** by Blackman and Vigna: 32 bytes of state and a handful of instructions per number, plenty for gameplay.
+// Meets the standard random engine requirements, so it drives the std and boost distributions like any other engine.
+class Xoshiro256 {
+    public:
+        typedef uint64_t result_type;
+
+        // Seeded from the operating system's entropy, so rooms started together still differ
+        Xoshiro256() {
+            std::random_device device;
+            Seed((static_cast<uint64_t>(device()) << 32) | device());
+        }
+
+        explicit Xoshiro256(uint64_t seed) {
+            Seed(seed);
+        }
+
+        void Seed(uint64_t seed) {
+            // Spread the seed over the state with splitmix64, so similar seeds give unrelated streams
+            for (int i = 0; i < 4; i++) {
+                seed += 0x9E3779B97F4A7C15ull;
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                state_[i] = z ^ (z >> 31);
+            }
+        }
+
+        static constexpr result_type min() {
+            return 0;
+        }
+
+        static constexpr result_type max() {
+            return UINT64_MAX;
+        }
+
+        result_type operator()() {
+            uint64_t result = Rotl(state_[1] * 5, 7) * 9;
+            uint64_t t = state_[1] << 17;
+            state_[2] ^= state_[0];
+            state_[3] ^= state_[1];
+            state_[1] ^= state_[2];
+            state_[0] ^= state_[3];
+            state_[2] ^= t;
+            state_[3] = Rotl(state_[3], 45);
+            return result;
+        }
+
+    private:
+        static uint64_t Rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        uint64_t state_[4];
+};
+
+#endif
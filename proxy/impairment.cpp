@@ -0,0 +1,97 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "impairment.hpp"
+
+namespace {
+
+// Sets one named field, returning false for unknown names or out of range values
+bool SetField(Impairment &impairment, const std::string &key, float value) {
+    bool probability = value >= 0 && value <= 1;
+    if (key == "latency" && value >= 0) {
+        impairment.latency_ms = value;
+    } else if (key == "jitter" && value >= 0) {
+        impairment.jitter_ms = value;
+    } else if (key == "loss" && probability) {
+        impairment.loss = value;
+    } else if (key == "duplicate" && probability) {
+        impairment.duplicate = value;
+    } else if (key == "reorder" && probability) {
+        impairment.reorder = value;
+    } else if (key == "bandwidth" && value >= 0) {
+        impairment.bandwidth_kbps = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}
+
+Profile::Profile(const Impairment &initial) {
+    ProfileStep step;
+    step.at_seconds = 0;
+    step.up = initial;
+    step.down = initial;
+    steps_.push_back(step);
+}
+
+Profile Profile::Load(const std::string &path, const Impairment &initial) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open profile " + path);
+    }
+
+    Profile profile(initial);
+    std::string line;
+    for (int line_num = 1; std::getline(file, line); line_num++) {
+        std::istringstream tokens(line);
+        std::string keyword;
+        if (!(tokens >> keyword) || keyword[0] == '#') {
+            // Blank line or comment
+            continue;
+        }
+        if (keyword != "at") {
+            throw std::runtime_error(path + ":" + std::to_string(line_num) + ": unknown keyword " + keyword);
+        }
+
+        // Steps build on the one before and must come in time order
+        ProfileStep step = profile.steps_.back();
+        std::string direction;
+        if (!(tokens >> step.at_seconds >> direction) || step.at_seconds < profile.steps_.back().at_seconds || 
+                (direction != "up" && direction != "down" && direction != "both")) {
+            throw std::runtime_error(path + ":" + std::to_string(line_num) + ": expected at <seconds> <up|down|both> in time order");
+        }
+        std::string key;
+        float value;
+        while (tokens >> key) {
+            if (!(tokens >> value) || 
+                    (direction != "down" && !SetField(step.up, key, value)) || 
+                    (direction != "up" && !SetField(step.down, key, value))) {
+                throw std::runtime_error(path + ":" + std::to_string(line_num) + ": bad setting " + key);
+            }
+        }
+
+        // A step at the same time replaces the one before
+        if (step.at_seconds == profile.steps_.back().at_seconds) {
+            profile.steps_.back() = step;
+        } else {
+            profile.steps_.push_back(step);
+        }
+    }
+
+    return profile;
+}
+
+size_t Profile::StepAt(double seconds) const {
+    size_t index = 0;
+    while (index + 1 < steps_.size() && steps_[index + 1].at_seconds <= seconds) {
+        index++;
+    }
+    return index;
+}
+
+const ProfileStep &Profile::Step(size_t index) const {
+    return steps_[index];
+}
@@ -0,0 +1,42 @@
+#ifndef IMPAIRMENT_H
+#define IMPAIRMENT_H
+
+#include <string>
+#include <vector>
+
+// What the proxy does to packets travelling in one direction
+struct Impairment {
+    float latency_ms = 0;
+    float jitter_ms = 0;       // Delay varies uniformly by up to this much either way
+    float loss = 0;            // Probability a packet is dropped
+    float duplicate = 0;       // Probability a packet is delivered twice
+    float reorder = 0;         // Probability a packet is held back so later ones overtake it
+    float bandwidth_kbps = 0;  // Link rate, 0 for unlimited
+};
+
+// Impairment of both directions from a point in time on
+struct ProfileStep {
+    double at_seconds;
+    Impairment up;    // Client to server
+    Impairment down;  // Server to client
+};
+
+// Scripted impairments over time. Profile files hold lines of the form
+//   at <seconds> <up|down|both> [latency <ms>] [jitter <ms>] [loss <p>] [duplicate <p>] [reorder <p>] [bandwidth <kbps>]
+// where each line changes only the settings it names, the last step holds until the proxy exits.
+class Profile {
+    public:
+        Profile(const Impairment &initial);
+
+        static Profile Load(const std::string &path, const Impairment &initial);
+
+        // Index of the step in effect after the given time
+        size_t StepAt(double seconds) const;
+
+        const ProfileStep &Step(size_t index) const;
+
+    private:
+        std::vector<ProfileStep> steps_;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "proxy.hpp"
+
+int main(int argc, char **argv) {
+    
+    try {
+        if (argc < 4) {
+            std::cerr << "Usage: LaserTagProxy <port> <server_address> <server_port> [--latency <ms>] [--jitter <ms>] [--loss <p>] [--duplicate <p>] "
+                      << "[--reorder <p>] [--bandwidth <kbps>] [--profile <file>] [--seed <n>] [--log <file>]" << std::endl;
+            return -1;
+        } else {
+            // Settings on the command line apply to both directions, a profile can change them over time
+            Impairment initial;
+            std::string profile_path, log_path;
+            unsigned int seed = 1;
+            for (int i = 4; i < argc; i++) {
+                std::string option(argv[i]);
+                if (option == "--latency" && i + 1 < argc) {
+                    initial.latency_ms = atof(argv[++i]);
+                } else if (option == "--jitter" && i + 1 < argc) {
+                    initial.jitter_ms = atof(argv[++i]);
+                } else if (option == "--loss" && i + 1 < argc) {
+                    initial.loss = atof(argv[++i]);
+                } else if (option == "--duplicate" && i + 1 < argc) {
+                    initial.duplicate = atof(argv[++i]);
+                } else if (option == "--reorder" && i + 1 < argc) {
+                    initial.reorder = atof(argv[++i]);
+                } else if (option == "--bandwidth" && i + 1 < argc) {
+                    initial.bandwidth_kbps = atof(argv[++i]);
+                } else if (option == "--profile" && i + 1 < argc) {
+                    profile_path = argv[++i];
+                } else if (option == "--seed" && i + 1 < argc) {
+                    seed = atoi(argv[++i]);
+                } else if (option == "--log" && i + 1 < argc) {
+                    log_path = argv[++i];
+                } else {
+                    std::cerr << "Unknown option " << option << std::endl;
+                    return -1;
+                }
+            }
+            Profile profile = profile_path.empty() ? Profile(initial) : Profile::Load(profile_path, initial);
+
+            // Log to a file if given, the same seed and profile give the same impairments for the same traffic
+            std::ofstream log_file;
+            if (!log_path.empty()) {
+                log_file.open(log_path.c_str());
+                if (!log_file) {
+                    throw std::runtime_error("Cannot open log " + log_path);
+                }
+            }
+
+            boost::asio::io_service io_service;
+            LaserTagProxy proxy(io_service, atoi(argv[1]), argv[2], argv[3], profile, seed, log_path.empty() ? std::cout : log_file);
+            std::cerr << "Proxy running" << std::endl;
+            io_service.run();
+        }
+    } catch (std::exception &exc) {
+        std::cerr << "Exception: " << exc.what() << std::endl;
+    }
+
+    return 0;
+}
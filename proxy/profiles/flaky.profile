@@ -0,0 +1,12 @@
+# Starts on a decent link, then degrades in stages and recovers
+at 0 both latency 20 jitter 2
+
+# Busy Wi-Fi: jitter, some loss and reordering on the way down
+at 10 both latency 40 jitter 15
+at 10 down loss 0.03 reorder 0.02 duplicate 0.01
+
+# Congested uplink
+at 20 up bandwidth 64 loss 0.05
+
+# Back to normal
+at 30 both latency 20 jitter 2 loss 0 reorder 0 duplicate 0 bandwidth 0
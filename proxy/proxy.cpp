@@ -0,0 +1,257 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include "proxy.hpp"
+
+using namespace Protocol;
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+// A rate limited link whose queue would hold a packet back longer than this drops it instead
+const std::chrono::milliseconds kMaxQueueDelay(500);
+
+// Extra delay of packets picked for reordering, on top of the jitter
+const float kReorderDelayMs = 20;
+
+// Clients that have been quiet this long lose their socket towards the server
+const std::chrono::seconds kFlowTimeout(30);
+
+const char *kDirectionNames[2] = {"up", "down"};
+
+}
+
+ProxyFlow::ProxyFlow(boost::asio::io_service &io_service, const boost::asio::ip::udp::endpoint &client) 
+    : client(client),
+      upstream(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0)),
+      last_active(Clock::now()) {
+    upstream.non_blocking(true);
+    for (int i = 0; i < 2; i++) {
+        link_free_at[i] = last_active;
+        max_seq_num[i] = 0;
+    }
+}
+
+LaserTagProxy::LaserTagProxy(boost::asio::io_service &io_service, short port, const std::string &server_host, const std::string &server_port, 
+        const Profile &profile, unsigned int seed, std::ostream &log) 
+    : io_service_(io_service),
+      socket_(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port)),
+      release_timer_(io_service),
+      log_timer_(io_service),
+      profile_(profile),
+      step_(0),
+      start_(Clock::now()),
+      random_(seed),
+      uniform_(0, 1),
+      log_(log),
+      release_armed_(false) {
+    // Resolve server endpoint
+    boost::asio::ip::udp::resolver resolver(io_service);
+    boost::asio::ip::udp::resolver::query query(boost::asio::ip::udp::v4(), server_host, server_port);
+    server_endpoint_ = *resolver.resolve(query);
+
+    // Deliveries are synchronous and dropped rather than blocking if the socket backs up
+    socket_.non_blocking(true);
+    ReceiveClient();
+
+    // Log a line per direction every second
+    log_ << "seconds,direction,packets_in,dropped,queue_drops,duplicated,reordered,packets_out,out_of_order,bytes_out,avg_delay_ms,flows" << std::endl;
+    log_timer_.expires_from_now(std::chrono::seconds(1));
+    log_timer_.async_wait(boost::bind(&LaserTagProxy::Log, this, _1));
+}
+
+void LaserTagProxy::ReceiveClient() {
+    socket_.async_receive_from(boost::asio::buffer(buffer_), sender_, MakeCustomAllocHandler(handler_memory_, 
+            [this](const boost::system::error_code &error, size_t bytes_transferred) { OnReceiveClient(error, bytes_transferred); }));
+}
+
+void LaserTagProxy::OnReceiveClient(const boost::system::error_code &error, size_t bytes_transferred) {
+    if (!error) {
+        // New clients get their own socket towards the server
+        std::shared_ptr<ProxyFlow> &flow = flows_[sender_];
+        if (!flow) {
+            flow.reset(new ProxyFlow(io_service_, sender_));
+            ReceiveServer(flow);
+        }
+        flow->last_active = Clock::now();
+        Impair(flow, up, buffer_, bytes_transferred);
+    }
+
+    // Receive next
+    ReceiveClient();
+}
+
+void LaserTagProxy::ReceiveServer(std::shared_ptr<ProxyFlow> flow) {
+    ProxyFlow *raw = flow.get();
+    raw->upstream.async_receive_from(boost::asio::buffer(raw->buffer), raw->sender, MakeCustomAllocHandler(raw->handler_memory, 
+            [this, flow](const boost::system::error_code &error, size_t bytes_transferred) { OnReceiveServer(error, bytes_transferred, flow); }));
+}
+
+void LaserTagProxy::OnReceiveServer(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<ProxyFlow> flow) {
+    if (error == boost::asio::error::operation_aborted) {
+        // Flow expired and its socket was closed
+        return;
+    }
+    if (!error && flow->sender == server_endpoint_) {
+        flow->last_active = Clock::now();
+        Impair(flow, down, flow->buffer, bytes_transferred);
+    }
+
+    // Receive next
+    ReceiveServer(flow);
+}
+
+void LaserTagProxy::Impair(std::shared_ptr<ProxyFlow> flow, Direction direction, const char *data, size_t size) {
+    // Follow the profile
+    Clock::time_point now = Clock::now();
+    size_t step = profile_.StepAt(Seconds(now));
+    if (step != step_) {
+        step_ = step;
+        log_ << "# " << std::fixed << std::setprecision(1) << Seconds(now) << " s: profile step " << step_ << std::endl;
+    }
+    const Impairment &impairment = direction == up ? profile_.Step(step_).up : profile_.Step(step_).down;
+    DirectionStats &stats = stats_[direction];
+    stats.packets_in++;
+
+    if (uniform_(random_) < impairment.loss) {
+        stats.dropped++;
+        return;
+    }
+    int copies = uniform_(random_) < impairment.duplicate ? 2 : 1;
+    stats.duplicated += copies - 1;
+
+    for (int copy = 0; copy < copies; copy++) {
+        // Rate limited links send one packet after another, new arrivals are dropped once the queue backs up too far
+        Clock::time_point departure = now;
+        if (impairment.bandwidth_kbps > 0) {
+            Clock::time_point &free_at = flow->link_free_at[direction];
+            std::chrono::duration<double> transmit_time(size * 8 / (impairment.bandwidth_kbps * 1000.0));
+            departure = std::max(now, free_at) + std::chrono::duration_cast<Clock::duration>(transmit_time);
+            if (departure - now > kMaxQueueDelay) {
+                stats.queue_drops++;
+                continue;
+            }
+            free_at = departure;
+        }
+
+        // Propagation delay with jitter, packets picked for reordering are held back further
+        float delay_ms = std::max(0.0f, impairment.latency_ms + impairment.jitter_ms * (2 * uniform_(random_) - 1));
+        if (uniform_(random_) < impairment.reorder) {
+            delay_ms += kReorderDelayMs + impairment.jitter_ms;
+            stats.reordered++;
+        }
+
+        DelayedPacket packet;
+        packet.flow = flow;
+        packet.direction = direction;
+        packet.received = now;
+        packet.data.assign(data, data + size);
+        Clock::time_point release = departure + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::milli>(delay_ms));
+        delayed_.insert(std::make_pair(release, std::move(packet)));
+    }
+
+    ScheduleRelease();
+}
+
+void LaserTagProxy::ScheduleRelease() {
+    // Wake up for the earliest packet, unless already waking up earlier
+    if (delayed_.empty()) {
+        return;
+    }
+    Clock::time_point next = delayed_.begin()->first;
+    if (release_armed_ && release_at_ <= next) {
+        return;
+    }
+    release_armed_ = true;
+    release_at_ = next;
+    release_timer_.expires_at(next);
+    release_timer_.async_wait(boost::bind(&LaserTagProxy::Release, this, _1));
+}
+
+void LaserTagProxy::Release(const boost::system::error_code &error) {
+    if (error == boost::asio::error::operation_aborted) {
+        // Superseded by an earlier wake up
+        return;
+    }
+    release_armed_ = false;
+
+    // Deliver everything that is due
+    Clock::time_point now = Clock::now();
+    while (!delayed_.empty() && delayed_.begin()->first <= now) {
+        Deliver(delayed_.begin()->second, now);
+        delayed_.erase(delayed_.begin());
+    }
+
+    ScheduleRelease();
+}
+
+void LaserTagProxy::Deliver(DelayedPacket &packet, Clock::time_point now) {
+    DirectionStats &stats = stats_[packet.direction];
+    ProxyFlow &flow = *packet.flow;
+
+    // Count packets that arrive behind a newer one, the receiver's sequence number check throws their state away
+    unsigned int seq_num = 0;
+    if (packet.direction == down && packet.data.size() >= sizeof(ServerDataHeader)) {
+        const ServerDataHeader *header = reinterpret_cast<const ServerDataHeader *>(packet.data.data());
+        if (header->version == kVersion) {
+            seq_num = header->server_seq_num;
+        }
+    } else if (packet.direction == up && packet.data.size() >= sizeof(ClientDataHeader)) {
+        const ClientDataHeader *header = reinterpret_cast<const ClientDataHeader *>(packet.data.data());
+        if (header->version == kVersion && (header->request == no_request || header->request == spectator_ack)) {
+            seq_num = header->seq_num;
+        }
+    }
+    if (seq_num != 0) {
+        if (seq_num < flow.max_seq_num[packet.direction]) {
+            stats.out_of_order++;
+        } else {
+            flow.max_seq_num[packet.direction] = seq_num;
+        }
+    }
+
+    boost::system::error_code ignored;
+    if (packet.direction == up) {
+        flow.upstream.send_to(boost::asio::buffer(packet.data), server_endpoint_, 0, ignored);
+    } else {
+        socket_.send_to(boost::asio::buffer(packet.data), flow.client, 0, ignored);
+    }
+    stats.packets_out++;
+    stats.bytes_out += packet.data.size();
+    stats.delay_ms_total += std::chrono::duration<double, std::milli>(now - packet.received).count();
+}
+
+void LaserTagProxy::Log(const boost::system::error_code &error) {
+    Clock::time_point now = Clock::now();
+
+    // Close flows of clients that went away
+    for (auto iter = flows_.begin(); iter != flows_.end(); /* Not while deleting */) {
+        if (now - iter->second->last_active > kFlowTimeout) {
+            boost::system::error_code ignored;
+            iter->second->upstream.close(ignored);
+            flows_.erase(iter++);
+        } else {
+            iter++;
+        }
+    }
+
+    // One line per direction for the last second
+    for (int direction = 0; direction < 2; direction++) {
+        DirectionStats &stats = stats_[direction];
+        log_ << std::fixed << std::setprecision(1) << Seconds(now) << "," << kDirectionNames[direction] << ","
+             << stats.packets_in << "," << stats.dropped << "," << stats.queue_drops << "," << stats.duplicated << "," << stats.reordered << ","
+             << stats.packets_out << "," << stats.out_of_order << "," << stats.bytes_out << ","
+             << std::setprecision(2) << (stats.packets_out ? stats.delay_ms_total / stats.packets_out : 0.0) << "," << flows_.size() << std::endl;
+        stats = DirectionStats();
+    }
+
+    log_timer_.expires_from_now(std::chrono::seconds(1));
+    log_timer_.async_wait(boost::bind(&LaserTagProxy::Log, this, _1));
+}
+
+double LaserTagProxy::Seconds(Clock::time_point time) {
+    return std::chrono::duration<double>(time - start_).count();
+}
@@ -0,0 +1,100 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+#include <ostream>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "protocol.hpp"
+#include "handler_allocator.hpp"
+#include "impairment.hpp"
+
+typedef enum {
+    up = 0,   // Client to server
+    down = 1  // Server to client
+} Direction;
+
+// One client's traffic through the proxy. Each client gets its own socket towards the server so the server still
+// tells clients apart by endpoint.
+struct ProxyFlow {
+    ProxyFlow(boost::asio::io_service &io_service, const boost::asio::ip::udp::endpoint &client);
+
+    boost::asio::ip::udp::endpoint client;
+    boost::asio::ip::udp::socket upstream;
+    alignas(16) char buffer[Protocol::kMaxDatagramSize];
+    boost::asio::ip::udp::endpoint sender;
+    HandlerMemory handler_memory;
+    std::chrono::steady_clock::time_point last_active;
+    std::chrono::steady_clock::time_point link_free_at[2]; // When each direction's rate limited link is next idle
+    unsigned int max_seq_num[2];                          // Highest sequence number delivered in each direction
+};
+
+// Counters for one direction over the current logging interval
+struct DirectionStats {
+    unsigned long packets_in = 0;
+    unsigned long dropped = 0;
+    unsigned long queue_drops = 0;
+    unsigned long duplicated = 0;
+    unsigned long reordered = 0;
+    unsigned long packets_out = 0;
+    unsigned long out_of_order = 0;  // Delivered behind a higher sequence number, the receiver drops their state
+    unsigned long bytes_out = 0;
+    double delay_ms_total = 0;
+};
+
+// Packet waiting in the proxy until its release time
+struct DelayedPacket {
+    std::shared_ptr<ProxyFlow> flow;
+    Direction direction;
+    std::chrono::steady_clock::time_point received;
+    std::vector<char> data;
+};
+
+// UDP proxy between clients and a server that applies latency, jitter, loss, duplication, reordering and bandwidth
+// caps per direction following a profile, logging what it did once a second as CSV
+class LaserTagProxy {
+    public:
+        LaserTagProxy(boost::asio::io_service &io_service, short port, const std::string &server_host, const std::string &server_port, 
+                const Profile &profile, unsigned int seed, std::ostream &log);
+
+    private:
+        void ReceiveClient();
+        void OnReceiveClient(const boost::system::error_code &error, size_t bytes_transferred);
+        void ReceiveServer(std::shared_ptr<ProxyFlow> flow);
+        void OnReceiveServer(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<ProxyFlow> flow);
+        void Impair(std::shared_ptr<ProxyFlow> flow, Direction direction, const char *data, size_t size);
+        void ScheduleRelease();
+        void Release(const boost::system::error_code &error);
+        void Deliver(DelayedPacket &packet, std::chrono::steady_clock::time_point now);
+        void Log(const boost::system::error_code &error);
+        double Seconds(std::chrono::steady_clock::time_point time);
+
+        boost::asio::io_service &io_service_;
+        boost::asio::ip::udp::socket socket_;
+        boost::asio::ip::udp::endpoint server_endpoint_;
+        boost::asio::steady_timer release_timer_;
+        boost::asio::steady_timer log_timer_;
+
+        alignas(16) char buffer_[Protocol::kMaxDatagramSize];
+        boost::asio::ip::udp::endpoint sender_;
+        HandlerMemory handler_memory_;
+
+        Profile profile_;
+        size_t step_;
+        std::chrono::steady_clock::time_point start_;
+        std::mt19937 random_;
+        std::uniform_real_distribution<float> uniform_;
+        std::ostream &log_;
+
+        std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<ProxyFlow>> flows_;
+        std::multimap<std::chrono::steady_clock::time_point, DelayedPacket> delayed_;
+        bool release_armed_;
+        std::chrono::steady_clock::time_point release_at_;
+        DirectionStats stats_[2];
+};
+
+#endif
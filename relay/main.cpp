@@ -0,0 +1,43 @@
+#include <iostream>
+#include <string>
+#include <algorithm>
+
+#include "relay.hpp"
+
+int main(int argc, char **argv) {
+    
+    try {
+        if (argc < 4) {
+            std::cerr << "Usage: LaserTagRelay <port> <upstream_address> <upstream_port> [--rate <min_hz> <max_hz>] [--budget <bytes_per_second>] [--packet <max_bytes>]" << std::endl;
+            return -1;
+        } else {
+            RelayConfig config;
+            config.port = atoi(argv[1]);
+            config.upstream_host = argv[2];
+            config.upstream_port = argv[3];
+            for (int i = 4; i < argc; i++) {
+                std::string option(argv[i]);
+                if (option == "--rate" && i + 2 < argc) {
+                    config.min_send_rate_hz = atof(argv[++i]);
+                    config.max_send_rate_hz = atof(argv[++i]);
+                } else if (option == "--budget" && i + 1 < argc) {
+                    config.subscriber_bytes_per_second = atoi(argv[++i]);
+                } else if (option == "--packet" && i + 1 < argc) {
+                    config.max_packet_bytes = std::max(512, std::min(atoi(argv[++i]), static_cast<int>(Protocol::kMaxDatagramSize)));
+                } else {
+                    std::cerr << "Unknown option " << option << std::endl;
+                    return -1;
+                }
+            }
+
+            boost::asio::io_service io_service;
+            LaserTagRelay relay(io_service, config);
+            std::cout << "Relay running" << std::endl;
+            io_service.run();
+        }
+    } catch (std::exception &exc) {
+        std::cerr << "Exception: " << exc.what() << std::endl;
+    }
+
+    return 0;
+}
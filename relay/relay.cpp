@@ -0,0 +1,381 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "relay.hpp"
+#include "packet_view.hpp"
+
+using namespace Protocol;
+
+namespace {
+
+// Upstream is resubscribed to once it has been quiet this long, which is also when it drops us
+const std::chrono::seconds kUpstreamTimeout(2);
+const std::chrono::seconds kSubscribeInterval(1);
+const std::chrono::milliseconds kAckInterval(50);
+
+// Subscribers that stop acking are dropped
+const std::chrono::seconds kSubscriberTimeout(2);
+
+// Players upstream has not sent for this many packets are dropped, in case a leave went missing
+const unsigned int kStaleGenerations = 600;
+
+// Subscribers have no position, so everyone comes round in turn with firing players more often
+float SpectatorWeight(const TransmittedData &other) {
+    return other.laser ? 4.0 : 1.0;
+}
+
+}
+
+RelaySubscriber::RelaySubscriber(const boost::asio::ip::udp::endpoint &endpoint, const SendScheduler &scheduler, SendScheduler::Clock::time_point now) 
+    : endpoint(endpoint),
+      last_received(now),
+      seq_num(1),
+      scheduler(scheduler) {}
+
+LaserTagRelay::LaserTagRelay(boost::asio::io_service &io_service, const RelayConfig &config) 
+    : config_(config),
+      upstream_socket_(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0)),
+      downstream_socket_(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), config.port)),
+      upstream_timer_(io_service),
+      tick_timer_(io_service),
+      subscribed_(false),
+      have_upstream_cookie_(false),
+      have_arena_hash_(false),
+      arena_hash_(0),
+      next_subscribe_(SendScheduler::Clock::now()),
+      upstream_seq_num_(1),
+      last_upstream_seq_num_(0),
+      players_(kStaleGenerations),
+      red_score_(0),
+      blue_score_(0) {
+    // Resolve upstream endpoint
+    boost::asio::ip::udp::resolver resolver(io_service);
+    boost::asio::ip::udp::resolver::query query(boost::asio::ip::udp::v4(), config.upstream_host, config.upstream_port);
+    upstream_endpoint_ = *resolver.resolve(query);
+
+    // Subscribe upstream and keep it acked
+    ReceiveUpstream();
+    SendUpstream(boost::system::error_code());
+
+    // Serve subscribers, synchronous sends fail rather than block
+    downstream_socket_.non_blocking(true);
+    ReceiveDownstream();
+    tick_timer_.expires_from_now(boost::posix_time::microseconds(static_cast<long>(1000000 / config_.max_send_rate_hz)));
+    tick_timer_.async_wait(boost::bind(&LaserTagRelay::Tick, this, _1));
+}
+
+void LaserTagRelay::ReceiveUpstream() {
+    // Only one upstream receive is outstanding, so it always reuses the same buffer and handler memory
+    upstream_socket_.async_receive_from(boost::asio::buffer(upstream_buffer_), upstream_sender_, MakeCustomAllocHandler(upstream_handler_memory_, 
+            [this](const boost::system::error_code &error, size_t bytes_transferred) { OnReceiveUpstream(error, bytes_transferred); }));
+}
+
+void LaserTagRelay::OnReceiveUpstream(const boost::system::error_code &error, size_t bytes_transferred) {
+    if (error == boost::asio::error::operation_aborted) {
+        // The socket was replaced by ResetUpstream, which receives on the new one
+        return;
+    }
+
+    // Upstream answers our first request with a challenge, echo its cookie straight back
+    const JoinChallenge *challenge = reinterpret_cast<const JoinChallenge *>(upstream_buffer_);
+    if (!error && upstream_sender_ == upstream_endpoint_ && bytes_transferred >= sizeof(JoinChallenge) && 
+            challenge->version == kVersion && challenge->client_player_num == kChallengePlayerNum) {
+        upstream_cookie_ = challenge->cookie;
+        have_upstream_cookie_ = true;
+        arena_hash_ = challenge->arena_hash;
+        have_arena_hash_ = true;
+        SendUpstreamHeader(spectate_request);
+        ReceiveUpstream();
+        return;
+    }
+
+    // Drop anything not from upstream or not a well formed packet
+    ServerPacketView packet;
+    if (error || upstream_sender_ != upstream_endpoint_ || !packet.Parse(upstream_buffer_, bytes_transferred)) {
+        ReceiveUpstream();
+        return;
+    }
+    const ServerDataHeader &header = packet.Header();
+
+    if (!subscribed_ && !config_.quiet) {
+        std::cout << "Subscribed to " << upstream_endpoint_.address() << ":" << upstream_endpoint_.port() << std::endl;
+    }
+    subscribed_ = true;
+    last_upstream_received_ = SendScheduler::Clock::now();
+    upstream_acks_.OnReceived(header.server_seq_num);
+
+    // Follow the game server's tick through however many relays are in between
+    if (upstream_timing_.OnReceived(header.send_time, header.echo_time, header.echo_delay, last_upstream_received_)) {
+        upstream_clock_.OnRttSample(header.send_time, upstream_timing_.LastSample(), last_upstream_received_);
+    }
+    upstream_clock_.OnTick(header.server_tick, header.send_time);
+
+    // Events are reliable, apply them in order and pass them on
+    for (const GameEvent *event = packet.EventsBegin(); event != packet.EventsEnd(); event++) {
+        upstream_events_.OnReceived(*event);
+    }
+    GameEvent event;
+    while (upstream_events_.Next(event)) {
+        HandleEvent(event);
+    }
+
+    // Player state is latest wins
+    if (header.server_seq_num > last_upstream_seq_num_) {
+        last_upstream_seq_num_ = header.server_seq_num;
+        for (const TransmittedData *data = packet.PlayersBegin(); data != packet.PlayersEnd(); data++) {
+            players_.Update(*data, last_upstream_seq_num_);
+        }
+    }
+
+    // Receive next
+    ReceiveUpstream();
+}
+
+void LaserTagRelay::HandleEvent(const GameEvent &event) {
+    switch (event.type) {
+        case (score_changed) : {
+            red_score_ = event.red_score;
+            blue_score_ = event.blue_score;
+            break;
+        }
+        case (player_left) : {
+            players_.Remove(event.player_num);
+            break;
+        }
+        default:
+            break;
+    }
+
+    // Subscribers see every event, renumbered on their own channel
+    BroadcastEvent(event);
+}
+
+void LaserTagRelay::SendUpstream(const boost::system::error_code &error) {
+    SendScheduler::Clock::time_point now = SendScheduler::Clock::now();
+
+    // Upstream went quiet (restarted or unreachable), start over with a fresh subscription
+    if (subscribed_ && now - last_upstream_received_ > kUpstreamTimeout) {
+        if (!config_.quiet) {
+            std::cout << "Lost " << upstream_endpoint_.address() << ":" << upstream_endpoint_.port() << ", resubscribing" << std::endl;
+        }
+        ResetUpstream();
+    }
+
+    // Keep asking until upstream answers, then ack what it sends
+    if (!subscribed_) {
+        if (now >= next_subscribe_) {
+            SendUpstreamHeader(spectate_request);
+            next_subscribe_ = now + kSubscribeInterval;
+        }
+    } else {
+        SendUpstreamHeader(spectator_ack);
+    }
+
+    upstream_timer_.expires_from_now(boost::posix_time::milliseconds(kAckInterval.count()));
+    upstream_timer_.async_wait(boost::bind(&LaserTagRelay::SendUpstream, this, _1));
+}
+
+void LaserTagRelay::SendUpstreamHeader(int request) {
+    ClientDataHeader header = ClientDataHeader();
+    header.version = kVersion;
+    header.request = request;
+    header.seq_num = upstream_seq_num_++;
+    header.ack = upstream_acks_.Ack();
+    header.ack_bits = upstream_acks_.AckBits();
+    upstream_timing_.Stamp(SendScheduler::Clock::now(), header.send_time, header.echo_time, header.echo_delay);
+    bool cookie = request == spectate_request && have_upstream_cookie_;
+    std::shared_ptr<std::vector<char>> datagram(new std::vector<char>(sizeof(ClientDataHeader) + (cookie ? sizeof(JoinCookie) : 0)));
+    memcpy(datagram->data(), &header, sizeof(ClientDataHeader));
+    if (cookie) {
+        memcpy(datagram->data() + sizeof(ClientDataHeader), &upstream_cookie_, sizeof(JoinCookie));
+    }
+    upstream_socket_.async_send_to(boost::asio::buffer(*datagram), upstream_endpoint_, boost::bind(&LaserTagRelay::OnSend, this, _1, _2, datagram));
+}
+
+void LaserTagRelay::ResetUpstream() {
+    // Tell subscribers everyone left, the new subscription brings back whoever is still there
+    players_.ForEachActive(last_upstream_seq_num_, [this](const TransmittedData &data) {
+        GameEvent left = GameEvent();
+        left.type = player_left;
+        left.player_num = data.player_num;
+        left.team = data.team;
+        BroadcastEvent(left);
+    });
+
+    // Upstream may still hold our old subscription, so subscribe afresh from a new endpoint and let the old one expire
+    boost::system::error_code ignored;
+    upstream_socket_.close(ignored);
+    upstream_socket_.open(boost::asio::ip::udp::v4());
+    upstream_socket_.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+    ReceiveUpstream();
+
+    // A new subscription starts its sequence numbers and events from scratch
+    subscribed_ = false;
+    have_upstream_cookie_ = false;
+    last_upstream_seq_num_ = 0;
+    upstream_acks_ = Reliability::AckTracker();
+    upstream_events_ = Reliability::EventReceiver();
+    upstream_timing_ = ClockSync::LinkTimer();
+    upstream_clock_ = ClockSync::ServerClock();
+    players_ = PlayerTable(kStaleGenerations);
+}
+
+void LaserTagRelay::ReceiveDownstream() {
+    downstream_socket_.async_receive_from(boost::asio::buffer(downstream_buffer_), downstream_sender_, MakeCustomAllocHandler(downstream_handler_memory_, 
+            [this](const boost::system::error_code &error, size_t bytes_transferred) { OnReceiveDownstream(error, bytes_transferred); }));
+}
+
+void LaserTagRelay::OnReceiveDownstream(const boost::system::error_code &error, size_t bytes_transferred) {
+    ClientPacketView packet;
+    if (!error && packet.Parse(downstream_buffer_, bytes_transferred)) {
+        const ClientDataHeader &header = packet.Header();
+        SendScheduler::Clock::time_point now = SendScheduler::Clock::now();
+        if (header.request == spectate_request && !have_arena_hash_) {
+            // Subscribers check our challenge for the game's map, which we only know once upstream challenged us
+        } else if (header.request == spectate_request && !(packet.Cookie() && cookies_.Verify(downstream_sender_, header.request, *packet.Cookie(), now))) {
+            // Nothing is kept for a subscriber until it proves it receives at its endpoint
+            Challenge(header.request, now);
+        } else if (header.request == spectate_request && subscribers_.find(downstream_sender_) == subscribers_.end()) {
+            // Repeated requests from a subscribed endpoint change nothing
+            SendScheduler scheduler(config_.min_send_rate_hz, config_.max_send_rate_hz, config_.subscriber_bytes_per_second);
+            RelaySubscriber &subscriber = subscribers_.insert(std::make_pair(downstream_sender_, RelaySubscriber(downstream_sender_, scheduler, now))).first->second;
+            if (!config_.quiet) {
+                std::cout << "Added subscriber at " << downstream_sender_.address() << ":" << downstream_sender_.port() << std::endl;
+            }
+
+            // Players reach the subscriber through snapshots, only the score needs telling
+            GameEvent score = GameEvent();
+            score.type = score_changed;
+            score.red_score = red_score_;
+            score.blue_score = blue_score_;
+            subscriber.events.Push(score);
+        } else if (header.request == spectator_ack) {
+            auto iter = subscribers_.find(downstream_sender_);
+            if (iter != subscribers_.end()) {
+                RelaySubscriber &subscriber = iter->second;
+                subscriber.last_received = now;
+                subscriber.acks.OnReceived(header.seq_num);
+                subscriber.events.OnAcks(header.ack, header.ack_bits);
+                subscriber.scheduler.OnReceived(header.seq_num);
+                subscriber.scheduler.OnAck(header.ack);
+                if (subscriber.timing.OnReceived(header.send_time, header.echo_time, header.echo_delay, now)) {
+                    subscriber.scheduler.OnRttSample(subscriber.timing.LastSample(), subscriber.timing.Rtt(), now);
+                }
+            }
+        }
+        // The relay is read-only, joins and player data are not passed upstream
+    }
+
+    // Receive next
+    ReceiveDownstream();
+}
+
+void LaserTagRelay::Challenge(int request, SendScheduler::Clock::time_point now) {
+    // Smaller than the request and dropped if the socket is backed up, as at the server
+    JoinChallenge challenge;
+    challenge.version = kVersion;
+    challenge.client_player_num = kChallengePlayerNum;
+    challenge.cookie = cookies_.Issue(downstream_sender_, request, now);
+    challenge.arena_hash = arena_hash_;
+    boost::system::error_code ignored;
+    downstream_socket_.send_to(boost::asio::buffer(&challenge, sizeof(JoinChallenge)), downstream_sender_, 0, ignored);
+}
+
+void LaserTagRelay::Tick(const boost::system::error_code &error) {
+    SendScheduler::Clock::time_point now = SendScheduler::Clock::now();
+
+    // Drop subscribers that stopped acking
+    for (auto iter = subscribers_.begin(); iter != subscribers_.end(); /* Not while deleting */) {
+        if (now - iter->second.last_received > kSubscriberTimeout) {
+            if (!config_.quiet) {
+                std::cout << "Subscriber at " << iter->first.address() << ":" << iter->first.port() << " left" << std::endl;
+            }
+            subscribers_.erase(iter++);
+        } else {
+            iter++;
+        }
+    }
+
+    // Gather the active players once for all subscribers
+    active_players_.clear();
+    players_.ForEachActive(last_upstream_seq_num_, [this](const TransmittedData &data) {
+        active_players_.push_back(data);
+    });
+    size_t max_players = (config_.max_packet_bytes - sizeof(ServerDataHeader)) / sizeof(TransmittedData);
+    size_t packet_bytes = sizeof(ServerDataHeader) + std::min(active_players_.size(), max_players) * sizeof(TransmittedData);
+
+    // Send to the subscribers that are due
+    for (auto iter = subscribers_.begin(); iter != subscribers_.end(); iter++) {
+        SendToSubscriber(iter->second, now, packet_bytes);
+    }
+
+    tick_timer_.expires_from_now(boost::posix_time::microseconds(static_cast<long>(1000000 / config_.max_send_rate_hz)));
+    tick_timer_.async_wait(boost::bind(&LaserTagRelay::Tick, this, _1));
+}
+
+void LaserTagRelay::SendToSubscriber(RelaySubscriber &subscriber, SendScheduler::Clock::time_point now, size_t packet_bytes) {
+    if (!subscriber.scheduler.ShouldSend(now, packet_bytes)) {
+        return;
+    }
+
+    // Header and pending events
+    ServerDataHeader header = ServerDataHeader();
+    header.version = kVersion;
+    header.client_player_num = kSpectatorPlayerNum;
+    header.server_seq_num = subscriber.seq_num++;
+    header.ack = subscriber.acks.Ack();
+    header.ack_bits = subscriber.acks.AckBits();
+    subscriber.timing.Stamp(now, header.send_time, header.echo_time, header.echo_delay);
+
+    // Times are ours, so the tick is our estimate of where the game server is at that time
+    header.server_tick = static_cast<unsigned int>(upstream_clock_.ServerTick(now));
+    std::vector<GameEvent> events;
+    subscriber.events.Write(header.server_seq_num, now, Reliability::EventSender::ResendAfter(subscriber.scheduler.Rtt()), events);
+
+    // Everyone accumulates priority while left out, take the highest that fit in the remaining space
+    size_t space = config_.max_packet_bytes - sizeof(ServerDataHeader) - events.size() * sizeof(GameEvent);
+    if (subscriber.priorities.size() < players_.Size()) {
+        subscriber.priorities.resize(players_.Size(), 0);
+    }
+    candidates_.clear();
+    for (size_t i = 0; i < active_players_.size(); i++) {
+        float &priority = subscriber.priorities[active_players_[i].player_num];
+        priority += SpectatorWeight(active_players_[i]);
+        candidates_.push_back(std::make_pair(priority, i));
+    }
+    size_t count = std::min(candidates_.size(), space / sizeof(TransmittedData));
+    std::nth_element(candidates_.begin(), candidates_.begin() + count, candidates_.end(), std::greater<std::pair<float, int>>());
+    header.num_events = events.size();
+    header.num_players = count;
+
+    // Lay out header, events and players in one datagram
+    size_t events_bytes = events.size() * sizeof(GameEvent);
+    std::shared_ptr<std::vector<char>> datagram(new std::vector<char>(sizeof(ServerDataHeader) + events_bytes + count * sizeof(TransmittedData)));
+    char *cursor = datagram->data();
+    memcpy(cursor, &header, sizeof(ServerDataHeader));
+    cursor += sizeof(ServerDataHeader);
+    memcpy(cursor, events.data(), events_bytes);
+    cursor += events_bytes;
+    for (size_t i = 0; i < count; i++, cursor += sizeof(TransmittedData)) {
+        const TransmittedData &data = active_players_[candidates_[i].second];
+        memcpy(cursor, &data, sizeof(TransmittedData));
+        subscriber.priorities[data.player_num] = 0;
+    }
+    subscriber.scheduler.OnSent(header.server_seq_num, now, datagram->size());
+
+    downstream_socket_.async_send_to(boost::asio::buffer(*datagram), subscriber.endpoint, boost::bind(&LaserTagRelay::OnSend, this, _1, _2, datagram));
+}
+
+void LaserTagRelay::BroadcastEvent(const GameEvent &event) {
+    // Queue the event on every subscriber's reliable channel
+    for (auto iter = subscribers_.begin(); iter != subscribers_.end(); iter++) {
+        iter->second.events.Push(event);
+    }
+}
+
+void LaserTagRelay::OnSend(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<std::vector<char>> datagram) {
+    // Method maintains ownership of the datagram until async send has completed
+}
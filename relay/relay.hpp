@@ -0,0 +1,106 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+
+#include "protocol.hpp"
+#include "send_scheduler.hpp"
+#include "reliability.hpp"
+#include "player_table.hpp"
+#include "handler_allocator.hpp"
+#include "join_cookies.hpp"
+#include "clock_sync.hpp"
+
+struct RelayConfig {
+    short port;
+    std::string upstream_host;
+    std::string upstream_port;
+    float min_send_rate_hz = 10;
+    float max_send_rate_hz = 30;
+    unsigned int subscriber_bytes_per_second = 64000;
+    unsigned int max_packet_bytes = Protocol::kMaxDatagramSize;
+    bool quiet = false;
+};
+
+// Read-only peer receiving the relay's packets, either a spectating client or another relay
+struct RelaySubscriber {
+    RelaySubscriber(const boost::asio::ip::udp::endpoint &endpoint, const SendScheduler &scheduler, SendScheduler::Clock::time_point now);
+
+    boost::asio::ip::udp::endpoint endpoint;
+    SendScheduler::Clock::time_point last_received;
+    unsigned int seq_num;
+    SendScheduler scheduler;
+    Reliability::AckTracker acks;
+    Reliability::EventSender events;
+    ClockSync::LinkTimer timing;
+    std::vector<float> priorities; // Indexed by player number
+};
+
+// Subscribes to a game server (or another relay) as a spectator and re-broadcasts its game to many subscribers,
+// so the server sends one stream per relay instead of one per viewer. Events are relayed reliably hop by hop and
+// player states are picked for each subscriber's packets by priority accumulators over the relay's player table.
+// Subscribers go through the same cookie handshake as joins at the server.
+class LaserTagRelay {
+    public:
+        LaserTagRelay(boost::asio::io_service &io_service, const RelayConfig &config);
+
+    private:
+        // Upstream
+        void ReceiveUpstream();
+        void OnReceiveUpstream(const boost::system::error_code &error, size_t bytes_transferred);
+        void HandleEvent(const Protocol::GameEvent &event);
+        void SendUpstream(const boost::system::error_code &error);
+        void SendUpstreamHeader(int request);
+        void ResetUpstream();
+
+        // Downstream
+        void ReceiveDownstream();
+        void OnReceiveDownstream(const boost::system::error_code &error, size_t bytes_transferred);
+        void Challenge(int request, SendScheduler::Clock::time_point now);
+        void Tick(const boost::system::error_code &error);
+        void SendToSubscriber(RelaySubscriber &subscriber, SendScheduler::Clock::time_point now, size_t packet_bytes);
+        void BroadcastEvent(const Protocol::GameEvent &event);
+        void OnSend(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<std::vector<char>> datagram);
+
+        RelayConfig config_;
+        boost::asio::ip::udp::socket upstream_socket_;
+        boost::asio::ip::udp::socket downstream_socket_;
+        boost::asio::ip::udp::endpoint upstream_endpoint_;
+        boost::asio::deadline_timer upstream_timer_;
+        boost::asio::deadline_timer tick_timer_;
+
+        // Upstream state
+        alignas(16) char upstream_buffer_[Protocol::kMaxDatagramSize];
+        boost::asio::ip::udp::endpoint upstream_sender_;
+        HandlerMemory upstream_handler_memory_;
+        bool subscribed_;
+        bool have_upstream_cookie_;
+        Protocol::JoinCookie upstream_cookie_;
+        bool have_arena_hash_;       // Learned from upstream's challenge and passed on in ours
+        unsigned int arena_hash_;
+        SendScheduler::Clock::time_point next_subscribe_;
+        SendScheduler::Clock::time_point last_upstream_received_;
+        unsigned int upstream_seq_num_;
+        unsigned int last_upstream_seq_num_;
+        Reliability::AckTracker upstream_acks_;
+        Reliability::EventReceiver upstream_events_;
+        ClockSync::LinkTimer upstream_timing_;
+        ClockSync::ServerClock upstream_clock_;
+        PlayerTable players_;
+        unsigned int red_score_, blue_score_;
+
+        // Downstream state
+        alignas(16) char downstream_buffer_[Protocol::kMaxDatagramSize];
+        boost::asio::ip::udp::endpoint downstream_sender_;
+        HandlerMemory downstream_handler_memory_;
+        JoinCookies cookies_;
+        std::map<boost::asio::ip::udp::endpoint, RelaySubscriber> subscribers_;
+        std::vector<Protocol::TransmittedData> active_players_;
+        std::vector<std::pair<float, int>> candidates_;
+};
+
+#endif
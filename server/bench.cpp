@@ -0,0 +1,264 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <unistd.h>
+
+#include "room.hpp"
+#include "reliability.hpp"
+#include "trace.hpp"
+
+using namespace Protocol;
+using namespace Geometry;
+
+typedef std::chrono::steady_clock Clock;
+
+// Scripted stand-in for a connected client
+struct SyntheticPlayer {
+    int player_num;
+    boost::asio::ip::udp::endpoint endpoint;
+    unsigned int seq_num;
+    Reliability::AckTracker acks;
+};
+
+struct BenchConfig {
+    std::vector<int> player_counts = {16, 64, 256, 1024, 4096, 16384, 50000};
+    int ticks = 1000;
+    double seconds = 20;
+    int fire_every = 60;
+    std::string map_path;
+    std::string trace_path;
+    bool idle = false;
+};
+
+struct Percentiles {
+    double p50, p90, p99, max;
+};
+
+Percentiles ComputePercentiles(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    Percentiles result;
+    result.p50 = samples[samples.size() * 50 / 100];
+    result.p90 = samples[samples.size() * 90 / 100];
+    result.p99 = samples[samples.size() * 99 / 100];
+    result.max = samples.back();
+    return result;
+}
+
+// Resident set size of the process in bytes, 0 where /proc is not available
+size_t ResidentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0, resident_pages = 0;
+    statm >> total_pages >> resident_pages;
+    return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+// Build idle sessions the way the room does, without the join events every other player would be sent, and report
+// what holding them costs. Once the room ticks every session fills its priority accumulators, so what the sessions hold
+// then is given as well.
+void RunIdle(const BenchConfig &bench, int num_players) {
+    Arena arena = bench.map_path.empty() ? Arena(-250, -250, 250, 250) : Arena::Load(bench.map_path);
+    SendScheduler scheduler(10, 60, 64000);
+    Xoshiro256 random;
+    Clock::time_point now = Clock::now();
+    size_t resident_before = ResidentBytes();
+    {
+        std::map<int, LaserTagClientSession> sessions;
+        size_t session_bytes = 0;
+        for (int i = 0; i < num_players; i++) {
+            TransmittedData data = TransmittedData();
+            data.player_num = i;
+            boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address_v4(0x0A000000 + i), 10000);
+            LaserTagClientSession &session = sessions.emplace(std::piecewise_construct, std::forward_as_tuple(i), 
+                    std::forward_as_tuple(endpoint, data, scheduler, arena, random, now)).first->second;
+            session_bytes += session.MemoryUsage();
+        }
+
+        size_t resident_bytes = ResidentBytes() - std::min(resident_before, ResidentBytes());
+        double ticking_bytes = session_bytes / num_players + LaserTagClientSession::kTrackedPriorities * sizeof(TrackedPriority);
+        std::cout << std::setw(8) << num_players << std::setw(12) << session_bytes / num_players << std::setw(12) << resident_bytes / num_players 
+                  << std::setw(12) << resident_bytes / (1024 * 1024) << std::setw(12) << size_t(ticking_bytes) 
+                  << std::setw(12) << size_t(ticking_bytes * num_players / (1024 * 1024)) << std::endl;
+    }
+}
+
+// Returns false if a session's event queue grew past its bound
+bool RunBench(const BenchConfig &bench, int num_players) {
+    ServerConfig config;
+    config.port = 0;
+    config.map_path = bench.map_path;
+    config.quiet = true;
+    LaserTagRoom room(config);
+
+    // Simulated time advances one tick interval per tick regardless of how long the tick took
+    Clock::time_point virtual_now = Clock::now();
+
+    // Join the players from distinct fake endpoints
+    std::vector<SyntheticPlayer> players(num_players);
+    ClientDataHeader join = ClientDataHeader();
+    join.request = true;
+    TransmittedData no_data = TransmittedData();
+    for (int i = 0; i < num_players; i++) {
+        boost::asio::ip::address_v4 address(0x0A000000 + i);
+        players[i].endpoint = boost::asio::ip::udp::endpoint(address, 10000);
+        players[i].seq_num = 1;
+        room.OnReceive(players[i].endpoint, join, no_data, virtual_now);
+    }
+    auto session_iter = room.Sessions().begin();
+    for (int i = 0; i < num_players; i++, session_iter++) {
+        players[i].player_num = session_iter->first;
+    }
+
+    // Packets produced by the tick are only counted and acknowledged
+    size_t packets = 0, bytes = 0;
+    std::map<int, SyntheticPlayer *> by_num;
+    for (SyntheticPlayer &player : players) {
+        by_num[player.player_num] = &player;
+    }
+    PacketSender sink = [&](LaserTagClientSession &session, std::shared_ptr<ServerDataHeader> header, 
+            std::shared_ptr<std::vector<GameEvent>> events, std::shared_ptr<std::vector<TransmittedData>> snapshot) {
+        packets++;
+        bytes += sizeof(ServerDataHeader) + events->size() * sizeof(GameEvent) + snapshot->size() * sizeof(TransmittedData);
+        by_num[header->client_player_num]->acks.OnReceived(header->server_seq_num);
+    };
+
+    std::vector<double> receive_us, tick_us, total_us;
+    size_t priority_bytes = 0, session_bytes = 0, max_pending = 0;
+    Clock::time_point bench_start = Clock::now();
+    std::map<int, LaserTagClientSession> &sessions = room.Sessions();
+    for (int tick = 0; tick < bench.ticks; tick++) {
+        // Every player moves along its own circle, fires now and then and reports its state
+        Clock::time_point receive_start = Clock::now();
+        for (int i = 0; i < num_players; i++) {
+            SyntheticPlayer &synthetic = players[i];
+            auto iter = sessions.find(synthetic.player_num);
+            if (iter == sessions.end()) {
+                continue;
+            }
+
+            Player player = iter->second.GetPlayer();
+            if ((tick + i) % 3 == 0) {
+                if (i % 2) player.RotateLeft(); else player.RotateRight();
+            }
+            Vector2D position = player.Position();
+            player.MoveForward();
+            if (room.GetArena().Collides(player.Position(), Player::kRadius)) {
+                player.SetPosition(position);
+                player.SetDirection(player.Direction() * -1);
+            }
+            player.SetLaser((tick + i) % bench.fire_every < 15);
+
+            ClientDataHeader header = ClientDataHeader();
+            header.seq_num = synthetic.seq_num++;
+            header.ack = synthetic.acks.Ack();
+            header.ack_bits = synthetic.acks.AckBits();
+            header.send_time = ClockSync::Millis(virtual_now);
+            header.echo_delay = ClockSync::kNoEcho;
+            room.OnReceive(synthetic.endpoint, header, player.Data(), virtual_now);
+        }
+
+        // Expiry, snapshots and sends
+        Clock::time_point tick_start = Clock::now();
+        virtual_now += room.TickInterval();
+        {
+            Trace::Span span("Tick");
+            span.SetArg("tick", tick);
+            room.Tick(virtual_now, sink);
+        }
+        Clock::time_point tick_end = Clock::now();
+
+        receive_us.push_back(std::chrono::duration<double, std::micro>(tick_start - receive_start).count());
+        tick_us.push_back(std::chrono::duration<double, std::micro>(tick_end - tick_start).count());
+        total_us.push_back(std::chrono::duration<double, std::micro>(tick_end - receive_start).count());
+
+        // Events keep coming for as long as players get hit, the queues must stay flat regardless
+        for (auto iter = sessions.begin(); iter != sessions.end(); iter++) {
+            max_pending = std::max(max_pending, iter->second.Events().Pending());
+        }
+
+        if (std::chrono::duration<double>(tick_end - bench_start).count() > bench.seconds) {
+            break;
+        }
+    }
+    session_bytes = room.MemoryUsage(priority_bytes) - priority_bytes;
+
+    Percentiles total = ComputePercentiles(total_us);
+    Percentiles receive = ComputePercentiles(receive_us);
+    Percentiles tick = ComputePercentiles(tick_us);
+    std::cout << std::fixed << std::setprecision(0)
+              << std::setw(8) << num_players << std::setw(8) << total_us.size()
+              << std::setw(12) << total.p50 << std::setw(12) << total.p90 << std::setw(12) << total.p99 << std::setw(12) << total.max
+              << std::setw(12) << receive.p50 << std::setw(12) << tick.p50
+              << std::setw(12) << double(packets) / total_us.size() << std::setw(12) << double(bytes) / total_us.size() / 1024
+              << std::setw(12) << session_bytes / num_players << std::setw(8) << max_pending << std::endl;
+
+    if (max_pending > Reliability::EventSender::kMaxPending) {
+        std::cerr << "Event queue reached " << max_pending << " events, bound is " << Reliability::EventSender::kMaxPending << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig bench;
+    for (int i = 1; i < argc; i++) {
+        std::string option(argv[i]);
+        if (option == "--players" && i + 1 < argc) {
+            // Comma separated list of room sizes
+            bench.player_counts.clear();
+            std::istringstream counts(argv[++i]);
+            std::string count;
+            while (std::getline(counts, count, ',')) {
+                bench.player_counts.push_back(atoi(count.c_str()));
+            }
+        } else if (option == "--ticks" && i + 1 < argc) {
+            bench.ticks = atoi(argv[++i]);
+        } else if (option == "--seconds" && i + 1 < argc) {
+            bench.seconds = atof(argv[++i]);
+        } else if (option == "--fire-every" && i + 1 < argc) {
+            bench.fire_every = std::max(1, atoi(argv[++i]));
+        } else if (option == "--map" && i + 1 < argc) {
+            bench.map_path = argv[++i];
+        } else if (option == "--trace" && i + 1 < argc) {
+            bench.trace_path = argv[++i];
+            Trace::Enable("LaserTagBench");
+        } else if (option == "--idle") {
+            bench.idle = true;
+        } else {
+            std::cerr << "Usage: LaserTagBench [--players <n,n,...>] [--ticks <n>] [--seconds <per size>] "
+                      << "[--fire-every <ticks>] [--map <file>] [--trace <file>] [--idle]" << std::endl;
+            return -1;
+        }
+    }
+
+    // Memory of connected players that have not played yet: sessions as counted by the room, and what the process grew by.
+    // Then the bytes per session and in total once the room ticks and the accumulators are full.
+    if (bench.idle) {
+        std::cout << std::setw(8) << "players" << std::setw(12) << "sess_B" << std::setw(12) << "rss_B" << std::setw(12) << "rss_MB" 
+                  << std::setw(12) << "tick_B" << std::setw(12) << "tick_MB" << std::endl;
+        for (int num_players : bench.player_counts) {
+            RunIdle(bench, num_players);
+        }
+        return 0;
+    }
+
+    // Per tick cost in microseconds, split into processing client packets and the tick itself, and session bytes per player
+    std::cout << std::setw(8) << "players" << std::setw(8) << "ticks" 
+              << std::setw(12) << "p50_us" << std::setw(12) << "p90_us" << std::setw(12) << "p99_us" << std::setw(12) << "max_us"
+              << std::setw(12) << "recv_p50" << std::setw(12) << "tick_p50" << std::setw(12) << "pkts/tick" << std::setw(12) << "KB/tick" << std::setw(12) << "sess_B" << std::setw(8) << "ev_max" << std::endl;
+    bool bounded = true;
+    for (int num_players : bench.player_counts) {
+        bounded = RunBench(bench, num_players) && bounded;
+    }
+
+    // The trace keeps the latest ticks of the last room sizes
+    if (!bench.trace_path.empty() && !Trace::Write(bench.trace_path)) {
+        std::cerr << "Could not write trace to " << bench.trace_path << std::endl;
+    }
+
+    return bounded ? 0 : -1;
+}
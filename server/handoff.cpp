@@ -0,0 +1,124 @@
+#include <string>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "handoff.hpp"
+
+namespace Handoff {
+
+namespace {
+
+// Far more than the state of any room that fits in memory, session event queues are bounded. A larger length is a
+// corrupt stream or not a server on the other end.
+const uint64_t kMaxStateBytes = uint64_t(1) << 30;
+
+// A successor that went away fails the write instead of raising SIGPIPE, so the running server can carry on
+void WriteAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            throw std::runtime_error("Handoff write failed: " + std::string(strerror(errno)));
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+void ReadAll(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t bytes = read(fd, data, size);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        } else if (bytes <= 0) {
+            throw std::runtime_error("Handoff connection closed");
+        }
+        data += bytes;
+        size -= bytes;
+    }
+}
+
+}
+
+void SendSocket(int unix_fd, int udp_fd, const std::vector<char> &state) {
+    // The descriptor rides along with the length of the state
+    uint64_t size = state.size();
+    struct iovec iov;
+    iov.iov_base = &size;
+    iov.iov_len = sizeof(size);
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &udp_fd, sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(unix_fd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0) {
+        throw std::runtime_error("Handoff sendmsg failed: " + std::string(strerror(errno)));
+    }
+
+    // The rest of the length if the stream took only part of it, then the state
+    WriteAll(unix_fd, reinterpret_cast<const char *>(&size) + sent, sizeof(size) - sent);
+    WriteAll(unix_fd, state.data(), state.size());
+}
+
+int ReceiveSocket(int unix_fd, std::vector<char> &state) {
+    uint64_t size = 0;
+    struct iovec iov;
+    iov.iov_base = &size;
+    iov.iov_len = sizeof(size);
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(unix_fd, &message, 0);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        throw std::runtime_error("Handoff connection closed");
+    }
+
+    // The descriptor arrives with the first byte
+    int fd = -1;
+    for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            memcpy(&fd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Handoff carried no socket");
+    }
+
+    try {
+        ReadAll(unix_fd, reinterpret_cast<char *>(&size) + received, sizeof(size) - received);
+        if (size > kMaxStateBytes) {
+            throw std::runtime_error("Handoff state of " + std::to_string(size) + " bytes is too large");
+        }
+        state.resize(size);
+        ReadAll(unix_fd, state.data(), state.size());
+    } catch (std::exception &exc) {
+        close(fd);
+        throw;
+    }
+    return fd;
+}
+
+}
@@ -0,0 +1,99 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+// Hot restart: a new server process connects to the running one over a Unix socket and is handed the bound UDP socket
+// along with the game state, so clients carry on without noticing the restart. The state is plain structs laid end to
+// end behind a StateHeader, a successor whose structs or map differ refuses it and the running server carries on.
+namespace Handoff {
+
+const unsigned int kStateMagic = 0x5448544C;  // "LTHT"
+
+// Bumped whenever the state's layout changes in a way the record sizes would not show
+const unsigned int kStateFormatVersion = 1;
+
+// Leads the state, its fields are only ever appended to
+struct StateHeader {
+    unsigned int magic;
+    unsigned int format_version;
+    unsigned int room_state_bytes;     // sizeof of each record as built into the sender
+    unsigned int session_state_bytes;
+    unsigned int event_bytes;
+    unsigned int arena_hash;           // Arena::Hash of the sender's map
+};
+
+// Appends values to a state buffer
+class Writer {
+    public:
+        Writer(std::vector<char> &out) 
+            : out_(out) {}
+
+        template <typename T>
+        void Write(const T &value) {
+            const char *bytes = reinterpret_cast<const char *>(&value);
+            out_.insert(out_.end(), bytes, bytes + sizeof(T));
+        }
+
+        template <typename T>
+        void WriteArray(const std::vector<T> &values) {
+            const char *bytes = reinterpret_cast<const char *>(values.data());
+            out_.insert(out_.end(), bytes, bytes + values.size() * sizeof(T));
+        }
+
+    private:
+        std::vector<char> &out_;
+};
+
+// Reads values back in the order they were written, throwing if the state is cut short
+class Reader {
+    public:
+        Reader(const char *data, size_t size) 
+            : data_(data),
+              remaining_(size) {}
+
+        template <typename T>
+        T Read() {
+            T value;
+            Take(&value, sizeof(T));
+            return value;
+        }
+
+        size_t Remaining() const {
+            return remaining_;
+        }
+
+        template <typename T>
+        void ReadArray(size_t count, std::vector<T> &values) {
+            if (count > remaining_ / sizeof(T)) {
+                throw std::runtime_error("Handoff state truncated");
+            }
+            values.resize(count);
+            Take(values.data(), count * sizeof(T));
+        }
+
+    private:
+        void Take(void *destination, size_t size) {
+            if (size > remaining_) {
+                throw std::runtime_error("Handoff state truncated");
+            }
+            memcpy(destination, data_, size);
+            data_ += size;
+            remaining_ -= size;
+        }
+
+        const char *data_;
+        size_t remaining_;
+};
+
+// Passes the UDP socket as SCM_RIGHTS ancillary data followed by the state, over a connected Unix stream socket
+void SendSocket(int unix_fd, int udp_fd, const std::vector<char> &state);
+
+// Counterpart of SendSocket, returns the received descriptor
+int ReceiveSocket(int unix_fd, std::vector<char> &state);
+
+}
+
+#endif
@@ -1,19 +1,57 @@
 #include <iostream>
+#include <string>
+#include <algorithm>
 
 #include "server.hpp"
+#include "trace.hpp"
 
 int main(int argc, char **argv) {
     
     try {
         if (argc < 2) {
-            std::cerr << "Usage: TeamBattle <port>" << std::endl;
+            std::cerr << "Usage: TeamBattle <port> [--rate <min_hz> <max_hz>] [--budget <bytes_per_second>] [--packet <max_bytes>] [--map <file>] [--receives <in_flight>] [--frontdoor <address> <port> <key>] [--trace <file>] [--stats <seconds>] [--handoff <socket>] [--takeover <socket>] [--busy-poll <cpu>]" << std::endl;
             return -1;
         } else {
-            short port = atoi(argv[1]);
+            ServerConfig config;
+            config.port = atoi(argv[1]);
+            for (int i = 2; i < argc; i++) {
+                std::string option(argv[i]);
+                if (option == "--rate" && i + 2 < argc) {
+                    config.min_send_rate_hz = atof(argv[++i]);
+                    config.max_send_rate_hz = atof(argv[++i]);
+                } else if (option == "--budget" && i + 1 < argc) {
+                    config.client_bytes_per_second = atoi(argv[++i]);
+                } else if (option == "--receives" && i + 1 < argc) {
+                    config.receives_in_flight = std::max(1, atoi(argv[++i]));
+                } else if (option == "--map" && i + 1 < argc) {
+                    config.map_path = argv[++i];
+                } else if (option == "--frontdoor" && i + 3 < argc) {
+                    config.frontdoor_host = argv[++i];
+                    config.frontdoor_port = argv[++i];
+                    config.frontdoor_key = argv[++i];
+                } else if (option == "--trace" && i + 1 < argc) {
+                    config.trace_path = argv[++i];
+                    Trace::Enable("LaserTagServer");
+                } else if (option == "--stats" && i + 1 < argc) {
+                    config.stats_seconds = std::max(0, atoi(argv[++i]));
+                } else if (option == "--handoff" && i + 1 < argc) {
+                    config.handoff_path = argv[++i];
+                } else if (option == "--takeover" && i + 1 < argc) {
+                    config.takeover_path = argv[++i];
+                } else if (option == "--busy-poll" && i + 1 < argc) {
+                    config.busy_poll_cpu = atoi(argv[++i]);
+                } else if (option == "--packet" && i + 1 < argc) {
+                    config.max_packet_bytes = std::max(512, std::min(atoi(argv[++i]), static_cast<int>(Protocol::kMaxDatagramSize)));
+                } else {
+                    std::cerr << "Unknown option " << option << std::endl;
+                    return -1;
+                }
+            }
+
             boost::asio::io_service io_service;
-            boost::shared_ptr<LaserTagServer> server(new LaserTagServer(io_service, port));
+            boost::shared_ptr<LaserTagServer> server(new LaserTagServer(io_service, config));
             std::cout << "Server running" << std::endl;
-            io_service.run();
+            server->Run();
         }
     } catch (std::exception &exc) {
         std::cerr << "Exception: " << exc.what() << std::endl;
@@ -0,0 +1,587 @@
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+
+#include "room.hpp"
+#include "protocol.hpp"
+#include "trace.hpp"
+#include "handoff.hpp"
+
+using namespace Protocol;
+using namespace Geometry;
+
+namespace {
+
+// How much a player matters to a receiver per packet it is left out of
+float PriorityWeight(const Player &receiver, const TransmittedData &other) {
+    // Nearby players matter most
+    float distance = Norm(receiver.Position() - Vector2D(other.x_pos, other.y_pos));
+    float weight = 1.0 / (1.0 + distance / 100.0);
+
+    // Firing players and opponents matter more
+    if (other.laser) {
+        weight *= 4.0;
+    }
+    if (other.team != receiver.Team()) {
+        weight *= 1.5;
+    }
+
+    return weight;
+}
+
+// Spectators have no position, so everyone comes round in turn with firing players more often
+float SpectatorWeight(const TransmittedData &other) {
+    return other.laser ? 4.0 : 1.0;
+}
+
+// Bookkeeping a std::map keeps per node besides the value: colour and three links
+const size_t kMapNodeOverhead = 4 * sizeof(void *);
+
+// Drop a session's accumulator for a player number that is being freed
+void ClearPriority(LaserTagClientSession &session, int player_num) {
+    std::vector<TrackedPriority> &priorities = session.Priorities();
+    for (auto iter = priorities.begin(); iter != priorities.end(); iter++) {
+        if (iter->player_num == static_cast<unsigned int>(player_num)) {
+            priorities.erase(iter);
+            return;
+        }
+    }
+}
+
+// Event about a player with the payload fields cleared
+GameEvent PlayerEvent(EventType type, const Player &player) {
+    GameEvent event = GameEvent();
+    event.type = type;
+    event.player_num = player.PlayerNum();
+    event.team = player.Team();
+    event.x_pos = player.Position().x;
+    event.y_pos = player.Position().y;
+    event.dir_x = player.Direction().x;
+    event.dir_y = player.Direction().y;
+    return event;
+}
+
+}
+
+LaserTagRoom::LaserTagRoom(const ServerConfig &config) 
+        : config_(config),
+          arena_(config.map_path.empty() ? Arena(-250, -250, 250, 250) : Arena::Load(config.map_path)) {
+    // Initialize variables
+    player_count_ = red_team_count_ = blue_team_count_ = red_score_ = blue_score_ = 0;
+    tick_load_ = 0;
+    tick_num_ = 0;
+    score_changed_ = false;
+
+    // Tick at the highest send rate, each session's scheduler decides whether it is due
+    tick_interval_ = std::chrono::microseconds(static_cast<long>(1000000 / config_.max_send_rate_hz));
+
+    // Players fall back on the arena's first spawn point when random ones keep failing, so there has to be one
+    Vector2D spawn(0, 0);
+    if (!arena_.FindSpawn(Player::kRadius, spawn)) {
+        throw std::runtime_error("Map has no room to spawn a player");
+    }
+}
+
+void LaserTagRoom::OnReceive(const boost::asio::ip::udp::endpoint &client_endpoint, const ClientDataHeader &header, const TransmittedData &data, 
+        std::chrono::steady_clock::time_point now) {
+    if (header.request == join_request) {
+        NewSession(client_endpoint, now);
+    } else if (header.request == spectate_request) {
+        NewSpectator(client_endpoint, now);
+    } else if (header.request == spectator_ack) {
+        // Spectators are known by their endpoint
+        auto iter = spectator_sessions_.find(client_endpoint);
+        if (iter == spectator_sessions_.end()) {
+            return;
+        }
+        iter->second.RecordReceived(header, now);
+    } else if (header.request == no_request) {
+        // Fetch client, ignoring data for sessions that do not exist (any more)
+        auto iter = client_sessions_.find(data.player_num);
+        if (iter == client_sessions_.end()) {
+            return;
+        }
+        LaserTagClientSession &update_session = iter->second;
+        if (update_session.GetEndpoint() != client_endpoint) {
+            // Player numbers are reused, so data from an old session's endpoint must not move the new player
+            return;
+        }
+        update_session.RecordReceived(header, now);
+        
+        // If we successfully update their data (i.e. data is valid and recent) and they are shooting, check for collisions
+        update_session.UpdateClientState(header.seq_num, data); 
+        
+        // If client is firing laser, do that
+        if(update_session.GetPlayer().Laser()) {
+            Laser(update_session);
+        }
+    }
+}
+
+void LaserTagRoom::NewSession(const boost::asio::ip::udp::endpoint &endpoint, std::chrono::steady_clock::time_point now) {
+    // Repeated requests from an endpoint that already plays change nothing
+    if (endpoint_players_.find(endpoint) != endpoint_players_.end()) {
+        return;
+    }
+
+    // Add new client to game, reusing the numbers of ended sessions so clients can index players densely
+    int player_num = player_count_;
+    if (!free_player_nums_.empty()) {
+        player_num = free_player_nums_.back();
+        free_player_nums_.pop_back();
+    } else {
+        player_count_++;
+    }
+    Team team = red_team_count_ > blue_team_count_ ? blue : red;
+    TransmittedData new_data;
+    new_data.player_num = player_num;
+    new_data.team = team;
+    new_data.laser = false;
+    SendScheduler scheduler(config_.min_send_rate_hz, config_.max_send_rate_hz, config_.client_bytes_per_second);
+    LaserTagClientSession &session = client_sessions_.emplace(std::piecewise_construct, std::forward_as_tuple(player_num), 
+            std::forward_as_tuple(endpoint, new_data, scheduler, arena_, random_, now)).first->second;
+    endpoint_players_[endpoint] = player_num;
+    
+    if (!config_.quiet) {
+        std::cout << "Added client session " << player_num << " at " << session.GetEndpoint().address() << std::endl;
+    }
+
+    // Tell everyone about the new player, and the new player about the current score. Where it spawned goes out in
+    // snapshots like any other state.
+    BroadcastEvent(PlayerEvent(player_joined, session.GetPlayer()));
+    GameEvent score = GameEvent();
+    score.type = score_changed;
+    score.red_score = red_score_;
+    score.blue_score = blue_score_;
+    session.Events().Push(score);
+    
+    // Update counters
+    if (team == blue) { 
+        blue_team_count_++;
+    } else { 
+        red_team_count_++;
+    }
+}
+
+void LaserTagRoom::NewSpectator(const boost::asio::ip::udp::endpoint &endpoint, std::chrono::steady_clock::time_point now) {
+    // Repeated requests from a subscribed endpoint change nothing, a restarted spectator comes back from a new endpoint
+    if (spectator_sessions_.find(endpoint) != spectator_sessions_.end()) {
+        return;
+    }
+
+    // Spectators hold a player that is never part of the game
+    TransmittedData no_player = TransmittedData();
+    no_player.player_num = kSpectatorPlayerNum;
+    SendScheduler scheduler(config_.min_send_rate_hz, config_.max_send_rate_hz, config_.client_bytes_per_second);
+    LaserTagClientSession &session = spectator_sessions_.emplace(std::piecewise_construct, std::forward_as_tuple(endpoint), 
+            std::forward_as_tuple(endpoint, no_player, scheduler, arena_, random_, now)).first->second;
+
+    if (!config_.quiet) {
+        std::cout << "Added spectator at " << endpoint.address() << ":" << endpoint.port() << std::endl;
+    }
+
+    // Players reach the spectator through snapshots, only the score needs telling
+    GameEvent score = GameEvent();
+    score.type = score_changed;
+    score.red_score = red_score_;
+    score.blue_score = blue_score_;
+    session.Events().Push(score);
+}
+
+void LaserTagRoom::Laser(LaserTagClientSession &firing_session) {
+    TRACE_SCOPE("Laser");
+
+    // Get firing player
+    const Player &firing = firing_session.GetPlayer();
+
+    // The laser stops at the nearest obstacle
+    float t_obstacle;
+    arena_.RayCast(firing.Position(), firing.Direction(), t_obstacle);
+
+    // Iterate through the opponents
+    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); iter++) {
+        // Extract the session and player from key value pair
+        LaserTagClientSession &opponent_session = iter->second;
+        const Player &opponent = opponent_session.GetPlayer();
+
+        // If this player is an opponent
+        if (opponent.Team() != firing.Team()) {
+            // If the laser intersects with the opponent before it hits an obstacle
+            std::vector<Vector2D> vertices = opponent.Vertices();
+            float t_opponent;
+            if (RayIntersectsConvexPolygon(vertices.data(), vertices.size(), firing.Position(), firing.Direction(), t_opponent) && t_opponent < t_obstacle) {
+                // Spawn the opponent, its new position reaches clients in snapshots
+                GameEvent hit = PlayerEvent(player_hit, opponent);
+                hit.other_num = firing.PlayerNum();
+                BroadcastEvent(hit);
+                opponent_session.Spawn(random_);
+
+                // Update the score
+                if (firing.Team() == blue) 
+                    blue_score_++; 
+                else 
+                    red_score_++;
+                score_changed_ = true;
+            }
+        }
+    }
+}
+
+void LaserTagRoom::BroadcastScore() {
+    // Scores are latest wins, so however many hits there were since the last tick take one event
+    if (!score_changed_) {
+        return;
+    }
+    score_changed_ = false;
+    GameEvent score = GameEvent();
+    score.type = score_changed;
+    score.red_score = red_score_;
+    score.blue_score = blue_score_;
+    BroadcastEvent(score);
+}
+
+void LaserTagRoom::BroadcastEvent(const GameEvent &event) {
+    // Queue the event on every client's reliable channel
+    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); iter++) {
+        iter->second.Events().Push(event);
+    }
+    for (auto iter = spectator_sessions_.begin(); iter != spectator_sessions_.end(); iter++) {
+        iter->second.Events().Push(event);
+    }
+}
+
+void LaserTagRoom::Tick(std::chrono::steady_clock::time_point tick_start, const PacketSender &send) {
+    std::chrono::steady_clock::time_point work_start = std::chrono::steady_clock::now();
+    tick_num_++;
+    BroadcastScore();
+
+    // Get state of game
+    std::shared_ptr<std::vector<TransmittedData>> game_state = GameState(tick_start);
+
+    // Packets hold as many players as fit in the byte budget
+    size_t max_players = (config_.max_packet_bytes - sizeof(ServerDataHeader)) / sizeof(TransmittedData);
+    size_t packet_bytes = sizeof(ServerDataHeader) + std::min(game_state->size(), max_players) * sizeof(TransmittedData);
+    
+    // Send state of game to the clients and spectators that are due
+    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); iter++) {
+        TickSession(iter->first, iter->second, *game_state, tick_start, packet_bytes, send);
+    }
+    for (auto iter = spectator_sessions_.begin(); iter != spectator_sessions_.end(); iter++) {
+        TickSession(-1, iter->second, *game_state, tick_start, packet_bytes, send);
+    }
+
+    // Track how much of the tick budget was used so schedulers can back off under load
+    std::chrono::duration<float> tick_time = std::chrono::steady_clock::now() - work_start;
+    tick_load_ = 0.9 * tick_load_ + 0.1 * (tick_time / tick_interval_);
+}
+
+void LaserTagRoom::TickSession(int client_num, LaserTagClientSession &session, const std::vector<TransmittedData> &game_state, 
+        std::chrono::steady_clock::time_point tick_start, size_t packet_bytes, const PacketSender &send) {
+    SendScheduler &scheduler = session.Scheduler();
+    scheduler.SetLoad(tick_load_);
+    if (!scheduler.ShouldSend(tick_start, packet_bytes)) {
+        return;
+    }
+
+    // Get header, pending events and the players that matter most to this client in the remaining space
+    std::shared_ptr<ServerDataHeader> header = HeaderForClient(client_num, session, tick_start);
+    std::shared_ptr<std::vector<GameEvent>> events(new std::vector<GameEvent>());
+    session.Events().Write(header->server_seq_num, tick_start, Reliability::EventSender::ResendAfter(scheduler.Rtt()), *events);
+    size_t space = config_.max_packet_bytes - sizeof(ServerDataHeader) - events->size() * sizeof(GameEvent);
+    std::shared_ptr<std::vector<TransmittedData>> snapshot = SnapshotForClient(client_num, session, game_state, space / sizeof(TransmittedData));
+    header->num_events = events->size();
+    header->num_players = snapshot->size();
+    scheduler.OnSent(header->server_seq_num, tick_start, 
+            sizeof(ServerDataHeader) + events->size() * sizeof(GameEvent) + snapshot->size() * sizeof(TransmittedData));
+
+    // Hand the packet over for sending
+    send(session, header, events, snapshot);
+}
+
+std::shared_ptr<std::vector<TransmittedData>> LaserTagRoom::SnapshotForClient(int client_num, LaserTagClientSession &session, 
+        const std::vector<TransmittedData> &game_state, size_t max_players) {
+    std::shared_ptr<std::vector<TransmittedData>> snapshot(new std::vector<TransmittedData>());
+    const Player &receiver = session.GetPlayer();
+    std::vector<TrackedPriority> &priorities = session.Priorities();
+
+    // The client always gets its own state. Everyone else competes with what they matter in this tick, plus what they
+    // accumulated while left out if the session tracks them. Spectators have no state of their own, and no player has
+    // their number. Ties go round in turn from a position that moves every tick.
+    unsigned int receiver_num = client_num < 0 ? kSpectatorPlayerNum : static_cast<unsigned int>(client_num);
+    size_t rotation = game_state.empty() ? 0 : tick_num_ % game_state.size();
+    auto state_index = [&](size_t key) { return key + rotation < game_state.size() ? key + rotation : key + rotation - game_state.size(); };
+    auto tracked = priorities.begin();
+    candidates_.clear();
+    for (size_t i = 0; i < game_state.size(); i++) {
+        const TransmittedData &other = game_state[i];
+        if (other.player_num == receiver_num) {
+            snapshot->push_back(other);
+        } else {
+            float priority = client_num < 0 ? SpectatorWeight(other) : PriorityWeight(receiver, other);
+
+            // The game state and the accumulators are both in player number order
+            while (tracked != priorities.end() && tracked->player_num < other.player_num) {
+                tracked++;
+            }
+            if (tracked != priorities.end() && tracked->player_num == other.player_num) {
+                priority += tracked->priority;
+            }
+            candidates_.push_back(std::make_pair(priority, i >= rotation ? i - rotation : i + game_state.size() - rotation));
+        }
+    }
+
+    // Take the highest priority players that fit, their accumulators start over. Of the players left out, keep
+    // accumulating for the most relevant and forget the rest, so a session's accumulators stay bounded however many
+    // players the room holds.
+    size_t count = std::min(candidates_.size(), max_players - snapshot->size());
+    size_t kept = std::min(candidates_.size() - count, LaserTagClientSession::kTrackedPriorities);
+    std::nth_element(candidates_.begin(), candidates_.begin() + count + kept, candidates_.end(), std::greater<std::pair<float, int>>());
+    std::nth_element(candidates_.begin(), candidates_.begin() + count, candidates_.begin() + count + kept, std::greater<std::pair<float, int>>());
+    for (size_t i = 0; i < count; i++) {
+        snapshot->push_back(game_state[state_index(candidates_[i].second)]);
+    }
+
+    // Priorities only grow from a positive weight, so the kept ones are marked by position in the game state and
+    // collected in player number order
+    kept_priorities_.resize(game_state.size(), 0);
+    for (size_t i = count; i < count + kept; i++) {
+        kept_priorities_[state_index(candidates_[i].second)] = candidates_[i].first;
+    }
+    priorities.clear();
+    for (size_t i = 0; i < game_state.size(); i++) {
+        if (kept_priorities_[i] > 0) {
+            TrackedPriority entry;
+            entry.player_num = game_state[i].player_num;
+            entry.priority = kept_priorities_[i];
+            priorities.push_back(entry);
+            kept_priorities_[i] = 0;
+        }
+    }
+
+    return snapshot;
+}
+
+std::shared_ptr<ServerDataHeader> LaserTagRoom::HeaderForClient(int client_num, LaserTagClientSession &session, 
+        std::chrono::steady_clock::time_point tick_start) {
+    // Create header for specific client, the contents are counted in once they are chosen
+    std::shared_ptr<ServerDataHeader> header(new ServerDataHeader());
+    header->version = kVersion;
+    header->client_player_num = client_num < 0 ? kSpectatorPlayerNum : client_num;
+    header->num_events = 0;
+    header->num_players = 0;
+    header->server_seq_num = session.NextSeqNum();
+    header->ack = session.Acks().Ack();
+    header->ack_bits = session.Acks().AckBits();
+    header->server_tick = tick_num_;
+    header->spawn_count = session.SpawnCount();
+    session.Timing().Stamp(tick_start, header->send_time, header->echo_time, header->echo_delay);
+    
+    return header;
+}
+
+std::shared_ptr<std::vector<TransmittedData>> LaserTagRoom::GameState(std::chrono::steady_clock::time_point now) {
+    TRACE_SCOPE("GameState");
+
+    // Buffer state of game
+    std::shared_ptr<std::vector<TransmittedData>> game_state(new std::vector<TransmittedData>());
+    
+    // Iterate over the client sessions
+    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); /* Not while deleting */) {
+        if (iter->second.SessionExpired(now)) {
+            // If client session has expired, remove them from the game
+            if (!config_.quiet) {
+                std::cout << "Client " << iter->first << " session ended" << std::endl;
+            }
+            if (iter->second.ClientState().team == blue) 
+                blue_team_count_--; 
+            else 
+                red_team_count_--;
+            int expired_num = iter->first;
+            GameEvent left = PlayerEvent(player_left, iter->second.GetPlayer());
+            endpoint_players_.erase(iter->second.GetEndpoint());
+            client_sessions_.erase(iter++);
+            BroadcastEvent(left);
+            free_player_nums_.push_back(expired_num);
+
+            // Whoever gets the number next starts with a clean accumulator everywhere
+            for (auto other = client_sessions_.begin(); other != client_sessions_.end(); other++) {
+                ClearPriority(other->second, expired_num);
+            }
+            for (auto other = spectator_sessions_.begin(); other != spectator_sessions_.end(); other++) {
+                ClearPriority(other->second, expired_num);
+            }
+        } else {
+            // Add the client state to the vector
+            game_state->push_back((iter++)->second.ClientState());         
+        }
+    }
+
+
+    // Drop spectators that stopped acking
+    for (auto iter = spectator_sessions_.begin(); iter != spectator_sessions_.end(); /* Not while deleting */) {
+        if (iter->second.SessionExpired(now)) {
+            if (!config_.quiet) {
+                std::cout << "Spectator at " << iter->first.address() << ":" << iter->first.port() << " left" << std::endl;
+            }
+            spectator_sessions_.erase(iter++);
+        } else {
+            iter++;
+        }
+    }
+
+    return game_state;
+}
+
+std::map<int, LaserTagClientSession> &LaserTagRoom::Sessions() {
+    return client_sessions_;
+}
+
+const Arena &LaserTagRoom::GetArena() {
+    return arena_;
+}
+
+std::chrono::microseconds LaserTagRoom::TickInterval() {
+    return tick_interval_;
+}
+
+ServerLoad LaserTagRoom::Load() {
+    ServerLoad load;
+    load.num_players = client_sessions_.size();
+    load.num_spectators = spectator_sessions_.size();
+    load.tick_load = tick_load_;
+    return load;
+}
+
+void LaserTagRoom::WriteStats(std::ostream &out) {
+    // One line per session with what the server knows of its link
+    auto write = [&out](const std::string &name, LaserTagClientSession &session) {
+        const ClockSync::LinkTimer &timing = session.Timing();
+        const SendScheduler &scheduler = session.Scheduler();
+        out << name << " at " << session.GetEndpoint().address() << ":" << session.GetEndpoint().port() << std::fixed << std::setprecision(1);
+        if (timing.HaveRtt()) {
+            out << " rtt " << timing.Rtt() * 1000 << " ms jitter " << timing.Jitter() * 1000 << " ms";
+        } else {
+            out << " rtt unknown";
+        }
+        out << " loss " << scheduler.Loss() * 100 << "% rate " << scheduler.Rate() << " Hz" << std::endl;
+    };
+    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); iter++) {
+        write("Client " + std::to_string(iter->first), iter->second);
+    }
+    for (auto iter = spectator_sessions_.begin(); iter != spectator_sessions_.end(); iter++) {
+        write("Spectator", iter->second);
+    }
+
+    // Footprint per connected player, with the priority accumulators shown apart
+    size_t sessions = client_sessions_.size() + spectator_sessions_.size();
+    if (sessions > 0) {
+        size_t priority_bytes;
+        size_t bytes = MemoryUsage(priority_bytes);
+        out << "Sessions hold " << (bytes - priority_bytes) / sessions << " bytes each plus " << priority_bytes / sessions 
+            << " bytes of priority accumulators" << std::endl;
+    }
+}
+
+size_t LaserTagRoom::MemoryUsage(size_t &priority_bytes) {
+    size_t bytes = 0;
+    priority_bytes = 0;
+    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); iter++) {
+        bytes += kMapNodeOverhead + sizeof(int) + iter->second.MemoryUsage();
+        bytes += kMapNodeOverhead + sizeof(std::pair<boost::asio::ip::udp::endpoint, int>);
+        priority_bytes += iter->second.Priorities().capacity() * sizeof(TrackedPriority);
+    }
+    for (auto iter = spectator_sessions_.begin(); iter != spectator_sessions_.end(); iter++) {
+        bytes += kMapNodeOverhead + sizeof(boost::asio::ip::udp::endpoint) + iter->second.MemoryUsage();
+        priority_bytes += iter->second.Priorities().capacity() * sizeof(TrackedPriority);
+    }
+    return bytes;
+}
+
+void LaserTagRoom::Save(std::vector<char> &state) {
+    BroadcastScore();
+    Handoff::Writer writer(state);
+    Handoff::StateHeader header;
+    header.magic = Handoff::kStateMagic;
+    header.format_version = Handoff::kStateFormatVersion;
+    header.room_state_bytes = sizeof(RoomState);
+    header.session_state_bytes = sizeof(SessionState);
+    header.event_bytes = sizeof(GameEvent);
+    header.arena_hash = arena_.Hash();
+    writer.Write(header);
+
+    RoomState room;
+    room.red_score = red_score_;
+    room.blue_score = blue_score_;
+    room.red_team_count = red_team_count_;
+    room.blue_team_count = blue_team_count_;
+    room.player_count = player_count_;
+    room.tick_num = tick_num_;
+    room.num_free_player_nums = free_player_nums_.size();
+    room.num_players = client_sessions_.size();
+    room.num_spectators = spectator_sessions_.size();
+    writer.Write(room);
+    writer.WriteArray(free_player_nums_);
+
+    // Each session followed by its unacked events
+    std::vector<GameEvent> events;
+    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); iter++) {
+        writer.Write(iter->second.Save(events));
+        writer.WriteArray(events);
+    }
+    for (auto iter = spectator_sessions_.begin(); iter != spectator_sessions_.end(); iter++) {
+        writer.Write(iter->second.Save(events));
+        writer.WriteArray(events);
+    }
+}
+
+void LaserTagRoom::Restore(const std::vector<char> &state, std::chrono::steady_clock::time_point now) {
+    // Refuse a state laid out by a different build, or of a game on another map, before touching anything
+    Handoff::Reader reader(state.data(), state.size());
+    Handoff::StateHeader header = reader.Read<Handoff::StateHeader>();
+    if (header.magic != Handoff::kStateMagic) {
+        throw std::runtime_error("Handoff state is not from a LaserTag server");
+    } else if (header.format_version != Handoff::kStateFormatVersion) {
+        throw std::runtime_error("Handoff state format " + std::to_string(header.format_version) + ", expected " + 
+                std::to_string(Handoff::kStateFormatVersion));
+    } else if (header.room_state_bytes != sizeof(RoomState) || header.session_state_bytes != sizeof(SessionState) || 
+            header.event_bytes != sizeof(GameEvent)) {
+        throw std::runtime_error("Handoff state records differ in size from this build's");
+    } else if (header.arena_hash != arena_.Hash()) {
+        throw std::runtime_error("Handoff state is of a game on another map, start with the running server's --map");
+    }
+
+    RoomState room = reader.Read<RoomState>();
+    red_score_ = room.red_score;
+    blue_score_ = room.blue_score;
+    red_team_count_ = room.red_team_count;
+    blue_team_count_ = room.blue_team_count;
+    player_count_ = room.player_count;
+    tick_num_ = room.tick_num;
+    reader.ReadArray(room.num_free_player_nums, free_player_nums_);
+
+    // Sessions carry on with their sequence numbers and events, link estimates start afresh
+    client_sessions_.clear();
+    spectator_sessions_.clear();
+    endpoint_players_.clear();
+    SendScheduler scheduler(config_.min_send_rate_hz, config_.max_send_rate_hz, config_.client_bytes_per_second);
+    std::vector<GameEvent> events;
+    for (unsigned int i = 0; i < room.num_players + room.num_spectators; i++) {
+        SessionState session = reader.Read<SessionState>();
+        reader.ReadArray(session.num_events, events);
+        if (i < room.num_players) {
+            int player_num = session.data.player_num;
+            LaserTagClientSession &restored = client_sessions_.emplace(std::piecewise_construct, std::forward_as_tuple(player_num), 
+                    std::forward_as_tuple(session, events, scheduler, arena_, now)).first->second;
+            endpoint_players_[restored.GetEndpoint()] = player_num;
+        } else {
+            boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address_v4(session.address), session.port);
+            spectator_sessions_.emplace(std::piecewise_construct, std::forward_as_tuple(endpoint), 
+                    std::forward_as_tuple(session, events, scheduler, arena_, now));
+        }
+    }
+    if (reader.Remaining() > 0) {
+        throw std::runtime_error("Handoff state has trailing bytes");
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <map>
+#include <ostream>
+#include <chrono>
+#include <functional>
+#include <boost/asio.hpp>
+
+#include "session.hpp"
+
+struct ServerConfig {
+    short port;
+    float min_send_rate_hz = 10;
+    float max_send_rate_hz = 60;
+    unsigned int client_bytes_per_second = 64000;
+    unsigned int max_packet_bytes = Protocol::kMaxDatagramSize;
+    std::string map_path;
+    bool quiet = false;
+    unsigned int receives_in_flight = 8;
+    std::string frontdoor_host;     // Front door to report load to, if any
+    std::string frontdoor_port;
+    std::string frontdoor_key;      // Hex key shared with the front door, reports are signed with it
+    std::string trace_path;         // Where the trace is written on SIGUSR1, tracing is off if empty
+    unsigned int stats_seconds = 0; // Interval of the per-session link stats, none if 0
+    std::string handoff_path;       // Unix socket a restarted server connects to for the game, none if empty
+    std::string takeover_path;      // Running server to take the game over from instead of binding the port
+    int busy_poll_cpu = -1;         // CPU the server spins on while players are connected, the reactor waits for packets if negative
+};
+
+// Room wide part of the hot restart state, followed by the free player numbers and the SessionStates of the players
+// and then the spectators
+struct RoomState {
+    int red_score, blue_score;
+    int red_team_count, blue_team_count;
+    int player_count;
+    unsigned int tick_num;
+    unsigned int num_free_player_nums;
+    unsigned int num_players;
+    unsigned int num_spectators;
+};
+
+// Packet chosen for a session during a tick: header, reliable events and player states
+typedef std::function<void(LaserTagClientSession &session, std::shared_ptr<Protocol::ServerDataHeader> header, 
+        std::shared_ptr<std::vector<Protocol::GameEvent>> events, std::shared_ptr<std::vector<Protocol::TransmittedData>> players)> PacketSender;
+
+// Game simulation of one room, independent of sockets so it can be driven by the server or a benchmark.
+// Spectators (such as relays) get the same packets as players but take no part in the game, they are passed around
+// with a client number of -1.
+class LaserTagRoom {
+    public:
+        LaserTagRoom(const ServerConfig &config);
+
+        void OnReceive(const boost::asio::ip::udp::endpoint &client_endpoint, const Protocol::ClientDataHeader &header, const Protocol::TransmittedData &data, 
+                std::chrono::steady_clock::time_point now);
+
+        void Tick(std::chrono::steady_clock::time_point tick_start, const PacketSender &send);
+
+        std::map<int, LaserTagClientSession> &Sessions();
+
+        const Arena &GetArena();
+
+        std::chrono::microseconds TickInterval();
+
+        Protocol::ServerLoad Load();
+
+        void WriteStats(std::ostream &out);
+
+        // Serializes scores, sessions and sequence numbers for a new process to Restore, which throws if the state is malformed,
+        // from a different build's layout or of another map
+        void Save(std::vector<char> &state);
+
+        void Restore(const std::vector<char> &state, std::chrono::steady_clock::time_point now);
+
+        // Bytes held by all sessions, and the part of it in priority accumulators
+        size_t MemoryUsage(size_t &priority_bytes);
+
+    private:
+        void NewSession(const boost::asio::ip::udp::endpoint &endpoint, std::chrono::steady_clock::time_point now);
+        void NewSpectator(const boost::asio::ip::udp::endpoint &endpoint, std::chrono::steady_clock::time_point now);
+        void TickSession(int client_num, LaserTagClientSession &session, const std::vector<Protocol::TransmittedData> &game_state, 
+                std::chrono::steady_clock::time_point tick_start, size_t packet_bytes, const PacketSender &send);
+        void Laser(LaserTagClientSession &firing_session);
+        void BroadcastEvent(const Protocol::GameEvent &event);
+        void BroadcastScore();
+        std::shared_ptr<Protocol::ServerDataHeader> HeaderForClient(int client_num, LaserTagClientSession &session, 
+                std::chrono::steady_clock::time_point tick_start);
+        std::shared_ptr<std::vector<Protocol::TransmittedData>> GameState(std::chrono::steady_clock::time_point now);
+        std::shared_ptr<std::vector<Protocol::TransmittedData>> SnapshotForClient(int client_num, LaserTagClientSession &session, 
+                const std::vector<Protocol::TransmittedData> &game_state, size_t max_players);
+
+        ServerConfig config_;
+        Arena arena_;
+        std::map<int, LaserTagClientSession> client_sessions_;
+        std::map<boost::asio::ip::udp::endpoint, LaserTagClientSession> spectator_sessions_;
+        std::map<boost::asio::ip::udp::endpoint, int> endpoint_players_;
+        int red_team_count_, blue_team_count_, player_count_;
+        std::vector<int> free_player_nums_;
+        int red_score_, blue_score_;
+        bool score_changed_;
+        std::chrono::microseconds tick_interval_;
+        unsigned int tick_num_;
+        float tick_load_;
+        std::vector<std::pair<float, int>> candidates_;
+        std::vector<float> kept_priorities_;  // By position in the game state, zero unless kept
+        Xoshiro256 random_;
+};
+
+#endif
@@ -1,173 +1,477 @@
 #include <iostream>
-#include <map>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "server.hpp"
 #include "protocol.hpp"
+#include "packet_view.hpp"
+#include "trace.hpp"
+#include "handoff.hpp"
 
 using namespace Protocol;
-using namespace Geometry;
 
-LaserTagServer::LaserTagServer(boost::asio::io_service &io_service, short port) 
-        : socket_(io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port)), 
-          timer_(io_service) {
-    // Initialize variables
-    player_count_ = red_team_count_ = blue_team_count_ = red_score_ = blue_score_ = 0;
-    server_seq_num_ = 0;
+namespace {
+
+// How long a receive may poll the device queue before giving up, where the kernel supports it
+const int kBusyPollMicros = 50;
+
+bool Idle(LaserTagRoom &room) {
+    ServerLoad load = room.Load();
+    return load.num_players + load.num_spectators == 0;
+}
+
+}
+
+LaserTagServer::LaserTagServer(boost::asio::io_service &io_service, const ServerConfig &config) 
+        : io_service_(io_service),
+          config_(config),
+          room_(config),
+          arena_hash_(room_.GetArena().Hash()),
+          socket_(io_service), 
+          timer_(io_service),
+          report_timer_(io_service),
+          stats_timer_(io_service),
+          report_cookie_(),
+          report_seq_num_(1),
+          signals_(io_service),
+          receive_buffers_(new DatagramBuffer[config.receives_in_flight]),
+          busy_polling_(false),
+          handoff_acceptor_(io_service),
+          handoff_socket_(io_service),
+          handing_over_(false),
+          sends_in_flight_(0) {
+    // The thread constructing the server goes on to Run it, spinning only pays off on a core the scheduler leaves alone,
+    // see isolcpus and nohz_full
+    if (config.busy_poll_cpu >= 0) {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.busy_poll_cpu, &cpus);
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (result != 0) {
+            throw std::runtime_error("Could not pin to CPU " + std::to_string(config.busy_poll_cpu) + ": " + strerror(result));
+        }
+#else
+        std::cerr << "Pinning to a CPU is not supported here, busy polling unpinned" << std::endl;
+#endif
+    }
+
+    if (!config.takeover_path.empty()) {
+        // Carry on the running server's game on its socket, ticking right away as its last tick may be a while ago
+        TakeOver();
+        next_tick_ = std::chrono::steady_clock::now();
+        timer_.expires_from_now(boost::posix_time::microseconds(0));
+    } else {
+        socket_.open(boost::asio::ip::udp::v4());
+        socket_.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), config.port));
+        next_tick_ = std::chrono::steady_clock::now() + room_.TickInterval();
+        timer_.expires_from_now(boost::posix_time::microseconds(room_.TickInterval().count()));
+    }
+
+    // Synchronous sends fail rather than block the io thread, and busy polling reads without blocking
+    socket_.non_blocking(true);
+
+#ifdef SO_BUSY_POLL
+    // Receives spin on the device queue instead of waiting for its interrupt, raising it needs CAP_NET_ADMIN
+    if (config.busy_poll_cpu >= 0) {
+        int busy_poll_us = kBusyPollMicros;
+        if (setsockopt(socket_.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) < 0) {
+            std::cerr << "Could not set SO_BUSY_POLL: " << strerror(errno) << std::endl;
+        }
+    }
+#endif
 
     // Begin sending game state to clients
-    timer_.expires_from_now(boost::posix_time::milliseconds(50));
     timer_.async_wait(boost::bind(&LaserTagServer::Send, this, _1));
+
+    // Wait for a restarted server to hand the game to
+    if (!config.handoff_path.empty()) {
+        unlink(config.handoff_path.c_str());
+        boost::asio::local::stream_protocol::endpoint endpoint(config.handoff_path);
+        handoff_acceptor_.open(endpoint.protocol());
+        handoff_acceptor_.bind(endpoint);
+        handoff_acceptor_.listen();
+        AcceptSuccessor();
+    }
     
-    // Begin receving data from clients
-    Receive();
-}
+    // Report our load to the front door, which sends joins our way
+    if (!config.frontdoor_host.empty()) {
+        boost::asio::ip::udp::resolver resolver(io_service);
+        boost::asio::ip::udp::resolver::query query(boost::asio::ip::udp::v4(), config.frontdoor_host, config.frontdoor_port);
+        frontdoor_endpoint_ = *resolver.resolve(query);
+        report_key_.reset(new ReportKey(config.frontdoor_key));
+        Report(boost::system::error_code());
+    }
 
-void LaserTagServer::Receive() {
-    // Initialize buffer
-    std::shared_ptr<ClientDataHeader> header(new ClientDataHeader());
-    std::shared_ptr<TransmittedData> data(new TransmittedData());
-    boost::array<boost::asio::mutable_buffer, 2> buffer = {boost::asio::buffer(header.get(), sizeof(ClientDataHeader)), boost::asio::buffer(data.get(), sizeof(TransmittedData))};
+    // Print how each session's link is doing now and then
+    if (config.stats_seconds > 0) {
+        stats_timer_.expires_from_now(boost::posix_time::seconds(config.stats_seconds));
+        stats_timer_.async_wait(boost::bind(&LaserTagServer::WriteStats, this, _1));
+    }
+
+    // Write the trace whenever asked to
+    if (!config.trace_path.empty()) {
+        signals_.add(SIGUSR1);
+        signals_.async_wait(boost::bind(&LaserTagServer::OnTraceSignal, this, _1, _2));
+    }
 
-    // Perform asynchronous read call
-    std::shared_ptr<boost::asio::ip::udp::endpoint> client_endpoint(new boost::asio::ip::udp::endpoint());
-    socket_.async_receive_from(buffer, *client_endpoint, 
-        boost::bind(&LaserTagServer::onReceive, this, _1, _2, client_endpoint, header, data));
+    // Begin receving data from clients, keeping several receives in flight
+    for (unsigned int i = 0; i < config.receives_in_flight; i++) {
+        Receive(receive_buffers_[i]);
+    }
 }
 
-void LaserTagServer::onReceive(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<boost::asio::ip::udp::endpoint> client_endpoint,
-        std::shared_ptr<ClientDataHeader> header, std::shared_ptr<TransmittedData> data) { 
-    // Process client data from async receive
-    if (!error) {
-        if (header->request) {
-            NewSession(*client_endpoint);
+void LaserTagServer::Run() {
+    if (config_.busy_poll_cpu < 0) {
+        io_service_.run();
+        return;
+    }
+
+    // Wait in the reactor while the room is idle, otherwise run whatever handlers are ready between polls of the socket
+    while (!io_service_.stopped()) {
+        if (busy_polling_) {
+            io_service_.poll();
+            BusyPoll();
         } else {
-            // Fetch client
-            LaserTagClientSession &update_session = client_sessions_.find(data->player_num)->second; // TODO if session doesn't exist will crash
-            
-            // If we successfully update their data (i.e. data is valid and recent) and they are shooting, check for collisions
-            update_session.UpdateClientState(header->seq_num, *data); 
-            
-            // If client is firing laser, do that
-            if(update_session.GetPlayer().Laser()) {
-                Laser(update_session);
-            }
+            io_service_.run_one();
         }
     }
+}
 
-    // Receive next client data
-    Receive();
+void LaserTagServer::Receive(DatagramBuffer &buffer) {
+    // Perform asynchronous read call straight into the preallocated slot, the operation itself lives in the slot's handler memory
+    buffer.in_flight = true;
+    socket_.async_receive_from(boost::asio::buffer(buffer.data, sizeof(buffer.data)), buffer.endpoint, 
+        MakeCustomAllocHandler(buffer.handler_memory, [this, &buffer](const boost::system::error_code &error, size_t bytes_transferred) {
+            this->onReceive(error, bytes_transferred, buffer);
+        }));
 }
 
-void LaserTagServer::NewSession(boost::asio::ip::udp::endpoint &endpoint) {
-    // Add new client to game
-    Team team = red_team_count_ > blue_team_count_ ? blue : red;
-    TransmittedData new_data;
-    new_data.player_num = player_count_;
-    new_data.team = team;
-    new_data.laser = false;
-    LaserTagClientSession new_session(endpoint, new_data);
-    client_sessions_.insert(std::pair<int, LaserTagClientSession>(player_count_, new_session));
-    
-    std::cout << "Added client session " << player_count_ << " at " << new_session.GetEndpoint().address() << std::endl;
-    
-    // Update counters
-    player_count_++;
-    if (team == blue) { 
-        blue_team_count_++;
-    } else { 
-        red_team_count_++;
-    }
-}
-
-void LaserTagServer::Laser(LaserTagClientSession &firing_session) {
-    // Get firing player
-    const Player &firing = firing_session.GetPlayer();
-
-    // Iterate through the opponents
-    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); iter++) {
-        // Extract the session and player from key value pair
-        LaserTagClientSession &opponent_session = iter->second;
-        const Player &opponent = opponent_session.GetPlayer();
-
-        // If this player is an opponent
-        if (opponent.Team() != firing.Team()) {
-            // If the laser intersects with the opponent
-            if (VectorIntersectsConvexPolygon(opponent.Vertices(), firing.Position(), firing.Direction())) {
-                // Spawn the opponent
-                opponent_session.Spawn();
-
-                // Update the score
-                if (firing.Team() == blue) 
-                    blue_score_++; 
-                else 
-                    red_score_++;
-            }
+void LaserTagServer::onReceive(const boost::system::error_code &error, size_t bytes_transferred, DatagramBuffer &buffer) { 
+    buffer.in_flight = false;
+    if (!error) {
+        HandleDatagram(buffer, bytes_transferred, std::chrono::steady_clock::now());
+    }
+
+    // Receive next client data into the same slot, unless the socket is being handed over or busy polled
+    if (handing_over_) {
+        HandOverWhenQuiet();
+    } else if (!busy_polling_) {
+        Receive(buffer);
+    }
+}
+
+void LaserTagServer::HandleDatagram(DatagramBuffer &buffer, size_t bytes_transferred, std::chrono::steady_clock::time_point now) {
+    // The front door challenges our reports, the cookie goes into the following ones
+    if (report_key_ && buffer.endpoint == frontdoor_endpoint_ && bytes_transferred == sizeof(JoinChallenge)) {
+        const JoinChallenge *challenge = reinterpret_cast<const JoinChallenge *>(buffer.data);
+        if (challenge->version == kVersion && challenge->client_player_num == kChallengePlayerNum) {
+            report_cookie_ = challenge->cookie;
+        }
+        return;
+    }
+
+    // Process client data, dropping packets that are truncated or from another protocol version
+    Trace::Span span("onReceive");
+    ClientPacketView packet;
+    if (packet.Parse(buffer.data, bytes_transferred)) {
+        span.SetArg("seq", packet.Header().seq_num);
+        int request = packet.Header().request;
+        if ((request == join_request || request == spectate_request) && 
+                !(packet.Cookie() && cookies_.Verify(buffer.endpoint, request, *packet.Cookie(), now))) {
+            // Nothing is allocated for a join until the requester proves it receives at its endpoint
+            Challenge(buffer.endpoint, request, now);
+        } else if (request == join_request && !(packet.ArenaHash() && *packet.ArenaHash() == arena_hash_)) {
+            // Players on another map would walk through our obstacles, the challenge told them which map to load
+        } else {
+            room_.OnReceive(buffer.endpoint, packet.Header(), packet.Data(), now);
         }
     }
 }
 
-void LaserTagServer::Send(const boost::system::error_code &error) {
-    // Get state of game
-    std::shared_ptr<std::vector<TransmittedData>> game_state = GameState();
-    
-    // Send state of game to all clients
-    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); iter++) {
-        // Get header
-        std::shared_ptr<ServerDataHeader> header = HeaderForClient(iter->first);
+void LaserTagServer::Challenge(const boost::asio::ip::udp::endpoint &endpoint, int request, std::chrono::steady_clock::time_point now) {
+    // Sent straight from the stack so a join flood costs a hash and a send per packet, the challenge is smaller than the 
+    // request so it cannot be used for amplification, and it is dropped if the socket is backed up
+    JoinChallenge challenge;
+    challenge.version = kVersion;
+    challenge.client_player_num = kChallengePlayerNum;
+    challenge.cookie = cookies_.Issue(endpoint, request, now);
+    challenge.arena_hash = arena_hash_;
+    boost::system::error_code ignored;
+    socket_.send_to(boost::asio::buffer(&challenge, sizeof(JoinChallenge)), endpoint, 0, ignored);
+}
 
-        // Buffer and write aysnc
-        boost::array<boost::asio::const_buffer, 2> buffer = {boost::asio::buffer(header.get(), sizeof(ServerDataHeader)), boost::asio::buffer(*game_state)};
-        socket_.async_send_to(buffer, iter->second.GetEndpoint(), boost::bind(&LaserTagServer::OnSend, this, _1, _2, game_state, header));
+void LaserTagServer::Send(const boost::system::error_code &error) {
+    if (error == boost::asio::error::operation_aborted || handing_over_) {
+        return;
     }
+    TRACE_SCOPE("Send");
 
-    // Update server sequence number
-    server_seq_num_++;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    Tick(now);
+
+    // Spin through the ticks while anyone is connected
+    if (config_.busy_poll_cpu >= 0 && !handing_over_ && !Idle(room_)) {
+        StartBusyPoll(now);
+        return;
+    }
 
     // Schedule event to send game state to all clients
-    timer_.expires_from_now(boost::posix_time::milliseconds(50));
+    next_tick_ = std::chrono::steady_clock::now() + room_.TickInterval();
+    timer_.expires_from_now(boost::posix_time::microseconds(room_.TickInterval().count()));
     timer_.async_wait(boost::bind(&LaserTagServer::Send, this, _1));
 }
 
-std::shared_ptr<ServerDataHeader> LaserTagServer::HeaderForClient(int client_num) {
-    // Create header for specific client
-    std::shared_ptr<ServerDataHeader> header(new ServerDataHeader());
-    header->client_player_num = client_num;
-    header->num_players = client_sessions_.size();
-    header->red_score = red_score_;
-    header->blue_score = blue_score_;
-    header->server_seq_num = server_seq_num_;
-    
-    return header;
+void LaserTagServer::Tick(std::chrono::steady_clock::time_point now) {
+    if (config_.stats_seconds > 0) {
+        tick_late_us_.push_back(std::chrono::duration<float, std::micro>(now - next_tick_).count());
+    }
+
+    // Run the room's tick, sending whatever packets it produces
+    room_.Tick(now, boost::bind(&LaserTagServer::SendPacket, this, _1, _2, _3, _4));
 }
 
+void LaserTagServer::StartBusyPoll(std::chrono::steady_clock::time_point now) {
+    // Datagrams are read straight off the socket until the room is idle again. Cancelling the receives in flight would
+    // abort the sends the tick just queued too, so they are left to complete and not re-armed. The work keeps the 
+    // io_service from stopping for lack of pending operations meanwhile.
+    busy_polling_ = true;
+    busy_work_.reset(new boost::asio::io_service::work(io_service_));
+    next_tick_ = now + room_.TickInterval();
+}
 
-std::shared_ptr<std::vector<TransmittedData>> LaserTagServer::GameState() {
-    // Buffer state of game
-    std::shared_ptr<std::vector<TransmittedData>> game_state(new std::vector<TransmittedData>());
-    
-    // Iterate over the client sessions
-    for (auto iter = client_sessions_.begin(); iter != client_sessions_.end(); /* Not while deleting */) {
-        if (iter->second.SessionExpired()) {
-            // If client session has expired, remove them from the game
-            std::cout << "Client " << iter->first << " session ended" << std::endl;
-            if (iter->second.ClientState().team == blue) 
-                blue_team_count_--; 
-            else 
-                red_team_count_--;
-            client_sessions_.erase(iter++);
-        } else {
-            // Add the client state to the vector
-            game_state->push_back((iter++)->second.ClientState());         
+void LaserTagServer::BusyPoll() {
+    // Handing over stopped the ticks, the handoff takes it from here
+    if (handing_over_) {
+        busy_polling_ = false;
+        busy_work_.reset();
+        return;
+    }
+
+    // Process whatever has arrived until the tick is due
+    DatagramBuffer &buffer = busy_buffer_;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    while (now < next_tick_) {
+        boost::system::error_code error;
+        size_t bytes_transferred = socket_.receive_from(boost::asio::buffer(buffer.data, sizeof(buffer.data)), buffer.endpoint, 0, error);
+        if (error) {
+            return;
+        }
+        HandleDatagram(buffer, bytes_transferred, now);
+        now = std::chrono::steady_clock::now();
+    }
+
+    TRACE_SCOPE("Send");
+    Tick(now);
+
+    // Ticks keep to their schedule unless one ran so long the next is already due
+    next_tick_ += room_.TickInterval();
+    if (next_tick_ <= now) {
+        next_tick_ = now + room_.TickInterval();
+    }
+
+    if (Idle(room_)) {
+        StopBusyPoll(now);
+    }
+}
+
+void LaserTagServer::StopBusyPoll(std::chrono::steady_clock::time_point now) {
+    // Back to waiting in the reactor until someone joins, slots whose receive is still pending re-arm when it completes
+    busy_polling_ = false;
+    busy_work_.reset();
+    for (unsigned int i = 0; i < config_.receives_in_flight; i++) {
+        if (!receive_buffers_[i].in_flight) {
+            Receive(receive_buffers_[i]);
         }
     }
+    timer_.expires_from_now(boost::posix_time::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(next_tick_ - now).count()));
+    timer_.async_wait(boost::bind(&LaserTagServer::Send, this, _1));
+}
 
-    return game_state;
+void LaserTagServer::SendPacket(LaserTagClientSession &session, std::shared_ptr<ServerDataHeader> header, 
+        std::shared_ptr<std::vector<GameEvent>> events, std::shared_ptr<std::vector<TransmittedData>> players) {
+    Trace::Span span("SendPacket");
+    span.SetArg("seq", header->server_seq_num);
+
+    // Buffer and write aysnc
+    sends_in_flight_++;
+    boost::array<boost::asio::const_buffer, 3> buffer = {boost::asio::buffer(header.get(), sizeof(ServerDataHeader)), boost::asio::buffer(*events), 
+        boost::asio::buffer(*players)};
+    socket_.async_send_to(buffer, session.GetEndpoint(), boost::bind(&LaserTagServer::OnSend, this, _1, _2, players, events, header));
 }
 
-void LaserTagServer::OnSend(const boost::system::error_code &error, size_t bytes_transferred, 
-        std::shared_ptr<std::vector<TransmittedData>> game_state, std::shared_ptr<ServerDataHeader> header) {
+void LaserTagServer::OnSend(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<std::vector<TransmittedData>> game_state, 
+        std::shared_ptr<std::vector<GameEvent>> events, std::shared_ptr<ServerDataHeader> header) {
     // Method maintains ownership of buffer data until async send has completed
+    sends_in_flight_--;
+    if (handing_over_) {
+        HandOverWhenQuiet();
+    }
+}
+
+void LaserTagServer::Report(const boost::system::error_code &error) {
+    if (error == boost::asio::error::operation_aborted) {
+        return;
+    }
+
+    // Report again every second, but not while handing over as the successor reports from the same socket
+    report_timer_.expires_from_now(boost::posix_time::seconds(1));
+    report_timer_.async_wait(boost::bind(&LaserTagServer::Report, this, _1));
+    if (handing_over_) {
+        return;
+    }
+
+    // Sent from the game socket, so the front door redirects clients to the address it sees this come from
+    ClientDataHeader header = ClientDataHeader();
+    header.version = kVersion;
+    header.request = server_report;
+    header.seq_num = report_seq_num_++;
+    ServerLoad load = room_.Load();
+    ReportAuth auth;
+    auth.cookie = report_cookie_;
+    std::shared_ptr<std::vector<char>> datagram(new std::vector<char>(sizeof(ClientDataHeader) + sizeof(ServerLoad) + sizeof(ReportAuth)));
+    memcpy(datagram->data(), &header, sizeof(ClientDataHeader));
+    memcpy(datagram->data() + sizeof(ClientDataHeader), &load, sizeof(ServerLoad));
+    memcpy(datagram->data() + sizeof(ClientDataHeader) + sizeof(ServerLoad), &auth.cookie, sizeof(JoinCookie));
+    report_key_->Sign(datagram->data(), auth);
+    memcpy(datagram->data() + sizeof(ClientDataHeader) + sizeof(ServerLoad), &auth, sizeof(ReportAuth));
+    sends_in_flight_++;
+    socket_.async_send_to(boost::asio::buffer(*datagram), frontdoor_endpoint_, boost::bind(&LaserTagServer::OnReport, this, _1, _2, datagram));
+}
+
+void LaserTagServer::OnReport(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<std::vector<char>> datagram) {
+    // Method maintains ownership of the datagram until async send has completed
+    sends_in_flight_--;
+    if (handing_over_) {
+        HandOverWhenQuiet();
+    }
+}
+
+void LaserTagServer::WriteStats(const boost::system::error_code &error) {
+    room_.WriteStats(std::cout);
+
+    // How late ticks started against their deadlines, the tail is what busy polling is for
+    if (!tick_late_us_.empty()) {
+        std::sort(tick_late_us_.begin(), tick_late_us_.end());
+        auto percentile = [this](size_t permille) {
+            return tick_late_us_[std::min(tick_late_us_.size() - 1, tick_late_us_.size() * permille / 1000)];
+        };
+        std::cout << std::fixed << std::setprecision(0) << "Ticks started late by p50 " << percentile(500) << " us p99 " << percentile(990) 
+                  << " us p999 " << percentile(999) << " us max " << tick_late_us_.back() << " us over " << tick_late_us_.size() << " ticks"
+                  << (busy_polling_ ? " busy polling" : "") << std::endl;
+        tick_late_us_.clear();
+    }
+
+    stats_timer_.expires_from_now(boost::posix_time::seconds(config_.stats_seconds));
+    stats_timer_.async_wait(boost::bind(&LaserTagServer::WriteStats, this, _1));
+}
+
+void LaserTagServer::OnTraceSignal(const boost::system::error_code &error, int signal) {
+    if (error) {
+        return;
+    }
+    if (Trace::Write(config_.trace_path)) {
+        std::cout << "Wrote trace to " << config_.trace_path << std::endl;
+    } else {
+        std::cerr << "Could not write trace to " << config_.trace_path << std::endl;
+    }
+
+    signals_.async_wait(boost::bind(&LaserTagServer::OnTraceSignal, this, _1, _2));
+}
+
+void LaserTagServer::TakeOver() {
+    handoff_socket_.connect(boost::asio::local::stream_protocol::endpoint(config_.takeover_path));
+    std::vector<char> state;
+    int fd = Handoff::ReceiveSocket(handoff_socket_.native_handle(), state);
+
+    // A state this build cannot take is refused by hanging up without the ack, the running server then carries on
+    try {
+        room_.Restore(state, std::chrono::steady_clock::now());
+    } catch (std::exception &exc) {
+        close(fd);
+        handoff_socket_.close();
+        throw;
+    }
+    socket_.assign(boost::asio::ip::udp::v4(), fd);
+
+    // Tell the old server it can exit
+    char ack = 1;
+    boost::asio::write(handoff_socket_, boost::asio::buffer(&ack, 1));
+    handoff_socket_.close();
+    std::cout << "Took over " << room_.Sessions().size() << " players" << std::endl;
+}
+
+void LaserTagServer::AcceptSuccessor() {
+    handoff_acceptor_.async_accept(handoff_socket_, boost::bind(&LaserTagServer::OnSuccessor, this, _1));
+}
+
+void LaserTagServer::OnSuccessor(const boost::system::error_code &error) {
+    if (error) {
+        AcceptSuccessor();
+        return;
+    }
+
+    // Stop ticking and re-arming receives, the state is saved once the last tick's sends are out
+    handing_over_ = true;
+    timer_.cancel();
+    HandOverWhenQuiet();
+}
+
+void LaserTagServer::HandOverWhenQuiet() {
+    if (sends_in_flight_ > 0) {
+        return;
+    }
+
+    // Only receives can be left on the socket now, abort them and hand over once the last has been processed
+    for (unsigned int i = 0; i < config_.receives_in_flight; i++) {
+        if (receive_buffers_[i].in_flight) {
+            socket_.cancel();
+            return;
+        }
+    }
+    io_service_.post(boost::bind(&LaserTagServer::HandOver, this));
+}
+
+void LaserTagServer::HandOver() {
+    std::vector<char> state;
+    room_.Save(state);
+    try {
+        Handoff::SendSocket(handoff_socket_.native_handle(), socket_.native_handle(), state);
+    } catch (std::exception &exc) {
+        std::cerr << "Handoff failed: " << exc.what() << std::endl;
+        Resume();
+        return;
+    }
+
+    // The successor acknowledges once it is running the game
+    boost::asio::async_read(handoff_socket_, boost::asio::buffer(&handoff_ack_, 1), boost::bind(&LaserTagServer::OnHandoffAck, this, _1, _2));
+}
+
+void LaserTagServer::OnHandoffAck(const boost::system::error_code &error, size_t bytes_transferred) {
+    if (!error && bytes_transferred == 1) {
+        std::cout << "Handed over " << room_.Sessions().size() << " players" << std::endl;
+        io_service_.stop();
+        return;
+    }
+
+    std::cerr << "Successor did not take over" << std::endl;
+    Resume();
+}
+
+void LaserTagServer::Resume() {
+    // The successor went away, so keep running the game and wait for another
+    handing_over_ = false;
+    handoff_socket_.close();
+    for (unsigned int i = 0; i < config_.receives_in_flight; i++) {
+        Receive(receive_buffers_[i]);
+    }
+    Send(boost::system::error_code());
+    AcceptSuccessor();
 }
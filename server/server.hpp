@@ -1,33 +1,85 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-#include <map>
+#include <vector>
+#include <memory>
+#include <chrono>
 #include <boost/asio.hpp>
 
-#include "session.hpp"
+#include "room.hpp"
+#include "handler_allocator.hpp"
+#include "join_cookies.hpp"
+
+// Preallocated slot a datagram is received into, along with its sender and the memory for the receive operation
+struct DatagramBuffer {
+    alignas(16) char data[Protocol::kMaxDatagramSize];
+    boost::asio::ip::udp::endpoint endpoint;
+    HandlerMemory handler_memory;
+    bool in_flight = false;  // A receive into the slot is pending
+};
 
 class LaserTagServer {
     public:
-        LaserTagServer(boost::asio::io_service &io_service, short port); 
+        LaserTagServer(boost::asio::io_service &io_service, const ServerConfig &config); 
+
+        // Runs the io_service until the server stops, spinning on the socket instead while busy polling
+        void Run();
 
     private:
-        void Receive();
-        void onReceive(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<boost::asio::ip::udp::endpoint> client_endpoint,
-                std::shared_ptr<Protocol::ClientDataHeader> header, std::shared_ptr<Protocol::TransmittedData> data); 
-        void NewSession(boost::asio::ip::udp::endpoint &endpoint);
-        void Laser(LaserTagClientSession &firing_session);
+        void Receive(DatagramBuffer &buffer);
+        void onReceive(const boost::system::error_code &error, size_t bytes_transferred, DatagramBuffer &buffer); 
+        void HandleDatagram(DatagramBuffer &buffer, size_t bytes_transferred, std::chrono::steady_clock::time_point now);
+        void Challenge(const boost::asio::ip::udp::endpoint &endpoint, int request, std::chrono::steady_clock::time_point now);
         void Send(const boost::system::error_code &error);
-        std::shared_ptr<Protocol::ServerDataHeader> HeaderForClient(int client_num);
-        std::shared_ptr<std::vector<Protocol::TransmittedData>> GameState();
-        void OnSend(const boost::system::error_code &error, size_t bytes_transferred, 
-                std::shared_ptr<std::vector<Protocol::TransmittedData>> game_state, std::shared_ptr<Protocol::ServerDataHeader> header);
+        void Tick(std::chrono::steady_clock::time_point now);
+        void StartBusyPoll(std::chrono::steady_clock::time_point now);
+        void BusyPoll();
+        void StopBusyPoll(std::chrono::steady_clock::time_point now);
+        void SendPacket(LaserTagClientSession &session, std::shared_ptr<Protocol::ServerDataHeader> header, 
+                std::shared_ptr<std::vector<Protocol::GameEvent>> events, std::shared_ptr<std::vector<Protocol::TransmittedData>> players);
+        void OnSend(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<std::vector<Protocol::TransmittedData>> game_state, 
+                std::shared_ptr<std::vector<Protocol::GameEvent>> events, std::shared_ptr<Protocol::ServerDataHeader> header);
+        void Report(const boost::system::error_code &error);
+        void OnTraceSignal(const boost::system::error_code &error, int signal);
+        void WriteStats(const boost::system::error_code &error);
+        void OnReport(const boost::system::error_code &error, size_t bytes_transferred, std::shared_ptr<std::vector<char>> datagram);
+        void TakeOver();
+        void AcceptSuccessor();
+        void OnSuccessor(const boost::system::error_code &error);
+        void HandOverWhenQuiet();
+        void HandOver();
+        void OnHandoffAck(const boost::system::error_code &error, size_t bytes_transferred);
+        void Resume();
         
+        boost::asio::io_service &io_service_;
+        ServerConfig config_;
+        LaserTagRoom room_;
+        JoinCookies cookies_;
+        unsigned int arena_hash_;
         boost::asio::ip::udp::socket socket_;
         boost::asio::deadline_timer timer_;
-        std::map<int, LaserTagClientSession> client_sessions_;
-        int red_team_count_, blue_team_count_, player_count_;
-        int red_score_, blue_score_;
-        int server_seq_num_;
+        boost::asio::deadline_timer report_timer_;
+        boost::asio::deadline_timer stats_timer_;
+        boost::asio::ip::udp::endpoint frontdoor_endpoint_;
+        std::unique_ptr<ReportKey> report_key_;
+        Protocol::JoinCookie report_cookie_;  // Latest the front door challenged us with
+        unsigned int report_seq_num_;
+        boost::asio::signal_set signals_;
+        std::unique_ptr<DatagramBuffer[]> receive_buffers_;
+
+        // Tick scheduling, the deadline is kept by the timer or, while busy polling, by spinning on the clock
+        std::chrono::steady_clock::time_point next_tick_;
+        bool busy_polling_;
+        std::unique_ptr<boost::asio::io_service::work> busy_work_;
+        DatagramBuffer busy_buffer_;  // Read into while busy polling, the slots may still have receives pending
+        std::vector<float> tick_late_us_;  // How late each tick started since the last stats, kept only with --stats
+
+        // Hot restart
+        boost::asio::local::stream_protocol::acceptor handoff_acceptor_;
+        boost::asio::local::stream_protocol::socket handoff_socket_;
+        bool handing_over_;
+        unsigned int sends_in_flight_;  // Handing over waits for these so the last tick's packets still go out
+        char handoff_ack_;
 };
 
 #endif
@@ -1,3 +1,6 @@
+#include <stdexcept>
+#include <boost/random.hpp>
+
 #include "session.hpp"
 #include "geometry.hpp"
 #include "player.hpp"
@@ -5,18 +8,53 @@
 using namespace Protocol;
 using namespace Geometry;
 
-LaserTagClientSession::LaserTagClientSession(boost::asio::ip::udp::endpoint client_endpoint, TransmittedData &data) 
-    : endpoint_(client_endpoint), 
-      last_received_(boost::posix_time::second_clock::local_time()),
-      player_(data),
-      seq_num_(0) {
-    // Random number generator
-    boost::posix_time::ptime time = boost::posix_time::microsec_clock::local_time();
-    boost::posix_time::time_duration duration(time.time_of_day());
-    random_num_gen_ = boost::mt19937(duration.total_milliseconds());
+const size_t LaserTagClientSession::kTrackedPriorities;
+
+LaserTagClientSession::Link::Link(const SendScheduler &scheduler)
+    : scheduler(scheduler) {
+}
 
+LaserTagClientSession::LaserTagClientSession(const boost::asio::ip::udp::endpoint &client_endpoint, const TransmittedData &data, const SendScheduler &scheduler, 
+        const Arena &arena, Xoshiro256 &random, std::chrono::steady_clock::time_point now) 
+    : player_(data),
+      endpoint_(client_endpoint), 
+      last_received_(now),
+      seq_num_(0),
+      server_seq_num_(1),
+      spawn_count_(0),
+      arena_(&arena),
+      link_(new Link(scheduler)) {
     // Spawn coordinates and direction
-    Spawn();
+    Spawn(random);
+}
+
+LaserTagClientSession::LaserTagClientSession(const SessionState &state, const std::vector<GameEvent> &events, const SendScheduler &scheduler, 
+        const Arena &arena, std::chrono::steady_clock::time_point now) 
+    : player_(state.data),
+      endpoint_(boost::asio::ip::address_v4(state.address), state.port),
+      last_received_(now),
+      seq_num_(state.seq_num),
+      server_seq_num_(state.server_seq_num),
+      spawn_count_(state.spawn_count),
+      acks_(state.ack, state.ack_bits),
+      arena_(&arena),
+      link_(new Link(scheduler)) {
+    link_->events.Restore(state.next_event_id, events);
+}
+
+SessionState LaserTagClientSession::Save(std::vector<GameEvent> &events) const {
+    SessionState state;
+    state.address = endpoint_.address().to_v4().to_ulong();
+    state.port = endpoint_.port();
+    state.data = player_.Data();
+    state.seq_num = seq_num_;
+    state.server_seq_num = server_seq_num_;
+    state.ack = acks_.Ack();
+    state.ack_bits = acks_.AckBits();
+    link_->events.Save(state.next_event_id, events);
+    state.num_events = events.size();
+    state.spawn_count = spawn_count_;
+    return state;
 }
 
 TransmittedData LaserTagClientSession::ClientState() {
@@ -27,38 +65,99 @@ const Player &LaserTagClientSession::GetPlayer() {
     return player_;
 }
 
-void LaserTagClientSession::UpdateClientState(int new_seq_num, TransmittedData &data) {
+void LaserTagClientSession::UpdateClientState(unsigned int new_seq_num, const TransmittedData &data) {
     if (new_seq_num < seq_num_) {
         // Check sequence number
         return;
     } else if (Norm(player_.Position() - Vector2D(data.x_pos, data.y_pos)) > 25) {
         // Check client didn't try to move too far
         return;
+    } else if (arena_->Collides(Vector2D(data.x_pos, data.y_pos), Player::kRadius)) {
+        // Check client didn't move into an obstacle or out of the arena
+        return;
     } else {
         // Update
-        last_received_ = boost::posix_time::second_clock::local_time();
         seq_num_ = new_seq_num;
         player_.Update(data);
     }
 }
 
+void LaserTagClientSession::RecordReceived(const ClientDataHeader &header, SendScheduler::Clock::time_point now) {
+    // Any datagram from the client keeps it alive, whether or not its move is accepted
+    last_received_ = now;
+
+    // Track what the client received so events can be released or resent
+    acks_.OnReceived(header.seq_num);
+    link_->events.OnAcks(header.ack, header.ack_bits);
+
+    // Feed the link quality estimates of the send scheduler, the round trip measured from the timestamps the client echoes
+    link_->scheduler.OnReceived(header.seq_num);
+    link_->scheduler.OnAck(header.ack);
+    if (link_->timing.OnReceived(header.send_time, header.echo_time, header.echo_delay, now)) {
+        link_->scheduler.OnRttSample(link_->timing.LastSample(), link_->timing.Rtt(), now);
+    }
+}
+
+SendScheduler &LaserTagClientSession::Scheduler() {
+    return link_->scheduler;
+}
+
+std::vector<TrackedPriority> &LaserTagClientSession::Priorities() {
+    return priorities_;
+}
+
+Reliability::EventSender &LaserTagClientSession::Events() {
+    return link_->events;
+}
+
+const Reliability::AckTracker &LaserTagClientSession::Acks() {
+    return acks_;
+}
+
+const ClockSync::LinkTimer &LaserTagClientSession::Timing() {
+    return link_->timing;
+}
+
+unsigned int LaserTagClientSession::NextSeqNum() {
+    return server_seq_num_++;
+}
+
 const boost::asio::ip::udp::endpoint &LaserTagClientSession::GetEndpoint() {
     return endpoint_;
 }
 
-bool LaserTagClientSession::SessionExpired() {
-    boost::posix_time::time_duration duration = boost::posix_time::second_clock::local_time() - last_received_;
-    return duration.seconds() > 2;
+bool LaserTagClientSession::SessionExpired(std::chrono::steady_clock::time_point now) {
+    return now - last_received_ > std::chrono::seconds(3);
+}
+
+size_t LaserTagClientSession::MemoryUsage() const {
+    return sizeof(LaserTagClientSession) + priorities_.capacity() * sizeof(TrackedPriority) + sizeof(Link) + link_->events.MemoryUsage();
 }
 
-void LaserTagClientSession::Spawn() {
-    // Random coordinates in game 
-    boost::uniform_real<> coord_distr(-250, 250);
-    boost::variate_generator<boost::mt19937 &, boost::uniform_real<>> coord_random(random_num_gen_, coord_distr);
-    player_.SetPosition(Vector2D(coord_random(), coord_random()));
+void LaserTagClientSession::Spawn(Xoshiro256 &random) {
+    // Random coordinates in game, retrying until clear of obstacles
+    boost::uniform_real<> x_distr(arena_->MinX() + Player::kRadius, arena_->MaxX() - Player::kRadius);
+    boost::uniform_real<> y_distr(arena_->MinY() + Player::kRadius, arena_->MaxY() - Player::kRadius);
+    boost::variate_generator<Xoshiro256 &, boost::uniform_real<>> x_random(random, x_distr);
+    boost::variate_generator<Xoshiro256 &, boost::uniform_real<>> y_random(random, y_distr);
+    Vector2D position(x_random(), y_random());
+    for (int attempt = 0; attempt < 100 && !arena_->ValidSpawn(position, Player::kRadius); attempt++) {
+        position = Vector2D(x_random(), y_random());
+    }
+
+    // On a crowded map take the first clear point of a scan instead, the room checked there is one
+    if (!arena_->ValidSpawn(position, Player::kRadius) && !arena_->FindSpawn(Player::kRadius, position)) {
+        throw std::runtime_error("Arena has no spawn point");
+    }
+    player_.SetPosition(position);
 
     // Random direction
     boost::uniform_int<> dir_distr(0, 71); // 5 degree turns (72 between 0 and 360)
-    boost::variate_generator<boost::mt19937 &, boost::uniform_int<>> dir_random(random_num_gen_, dir_distr);
+    boost::variate_generator<Xoshiro256 &, boost::uniform_int<>> dir_random(random, dir_distr);
     player_.SetDirection(RotateDegrees(Vector2D(1, 0), dir_random()));
+    spawn_count_++;
+}
+
+unsigned int LaserTagClientSession::SpawnCount() const {
+    return spawn_count_;
 }
@@ -1,29 +1,105 @@
+#include <vector>
+#include <chrono>
+#include <memory>
 #include <boost/asio.hpp>
-#include <boost/random.hpp>
 
 #include "player.hpp"
 #include "geometry.hpp"
+#include "arena.hpp"
+#include "send_scheduler.hpp"
+#include "reliability.hpp"
+#include "clock_sync.hpp"
+#include "xoshiro.hpp"
 
+// What carries a session over to a new process on a hot restart, followed by num_events GameEvents
+struct SessionState {
+    unsigned int address;         // IPv4 address in host byte order
+    unsigned int port;
+    Protocol::TransmittedData data;
+    unsigned int seq_num;
+    unsigned int server_seq_num;
+    unsigned int ack;
+    unsigned int ack_bits;
+    unsigned int next_event_id;
+    unsigned int num_events;
+    unsigned int spawn_count;
+};
+
+// Priority a player the session tracks has accumulated while left out of its snapshots
+struct TrackedPriority {
+    unsigned int player_num;
+    float priority;
+};
+
+// Server side of one client's connection. Sessions are kept small so a server can hold very many: randomness comes
+// from the room's generator, and the record holds what is touched on every tick while the scheduler, timing and event
+// histories live out of line.
 class LaserTagClientSession {
     public:
-        LaserTagClientSession(boost::asio::ip::udp::endpoint client_endpoint, Protocol::TransmittedData &data); 
+        // Players whose priority a session keeps accumulating, about a packet's worth besides those sent. The rest
+        // compete on what they matter in the tick.
+        static const size_t kTrackedPriorities = 64;
+
+        LaserTagClientSession(const boost::asio::ip::udp::endpoint &client_endpoint, const Protocol::TransmittedData &data, const SendScheduler &scheduler, 
+                const Arena &arena, Xoshiro256 &random, std::chrono::steady_clock::time_point now); 
+
+        // Session continued from another process, the player stays where it was
+        LaserTagClientSession(const SessionState &state, const std::vector<Protocol::GameEvent> &events, const SendScheduler &scheduler, 
+                const Arena &arena, std::chrono::steady_clock::time_point now);
+
+        SessionState Save(std::vector<Protocol::GameEvent> &events) const;
 
         Protocol::TransmittedData ClientState();
 
         const Player &GetPlayer();
 
-        void UpdateClientState(int new_seq_num, Protocol::TransmittedData &data);
+        void UpdateClientState(unsigned int new_seq_num, const Protocol::TransmittedData &data);
+
+        void RecordReceived(const Protocol::ClientDataHeader &header, SendScheduler::Clock::time_point now);
+
+        SendScheduler &Scheduler();
+
+        // Accumulators of at most kTrackedPriorities players, in player number order
+        std::vector<TrackedPriority> &Priorities();
+
+        Reliability::EventSender &Events();
+
+        const Reliability::AckTracker &Acks();
+
+        const ClockSync::LinkTimer &Timing();
+
+        unsigned int NextSeqNum();
 
         const boost::asio::ip::udp::endpoint &GetEndpoint();
 
-        bool SessionExpired();
+        bool SessionExpired(std::chrono::steady_clock::time_point now);
+
+        void Spawn(Xoshiro256 &random);
 
-        void Spawn();
+        // Spawns so far, sent in every header so the client takes its spawn from the snapshot
+        unsigned int SpawnCount() const;
+
+        // Bytes held by the session including what it allocated
+        size_t MemoryUsage() const;
 
     private:
+        // Link state with its histories, kept out of line
+        struct Link {
+            Link(const SendScheduler &scheduler);
+
+            SendScheduler scheduler;
+            ClockSync::LinkTimer timing;
+            Reliability::EventSender events;
+        };
+
+        Player player_;
         boost::asio::ip::udp::endpoint endpoint_;
-        boost::posix_time::ptime last_received_;
+        std::chrono::steady_clock::time_point last_received_;
         unsigned int seq_num_;
-        boost::mt19937 random_num_gen_; 
-        Player player_;
+        unsigned int server_seq_num_;
+        unsigned int spawn_count_;
+        Reliability::AckTracker acks_;
+        std::vector<TrackedPriority> priorities_;
+        const Arena *arena_;
+        std::unique_ptr<Link> link_;
 };